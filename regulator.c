@@ -16,21 +16,107 @@
 #include <string.h>
 #include <stdlib.h>
 #include <signal.h>
+#include <errno.h>
+#include <time.h>
 
 #include "regulator.h"
 #include "regulator_pulseaudio.h"
 #include "regulator_sndfile.h"
+#include "regulator_multi.h"
+#include "regulator_raw.h"
+#include "regulator_kernels.h"
+#include "regulator_timeline.h"
+#include "regulator_drift.h"
+#include "regulator_bootstrap.h"
+#include "regulator_fit.h"
+#include "regulator_precision.h"
+#include "regulator_filter.h"
+#include "regulator_daemon.h"
+#include "regulator_trace.h"
+#include "regulator_gap.h"
+#include "regulator_realtime.h"
+#ifdef HAVE_ALSA
+#include "regulator_alsa.h"
+#endif
 
 struct regulator_t* regulator_sighandler_ptr = NULL;
 
-void regulator_read_first_batch_of_ticks(struct regulator_t* rp) {
+static const regulator_backend_t* regulator_backends[] = {
+    &regulator_pulseaudio_backend,
+    &regulator_sndfile_backend,
+    &regulator_raw_backend,
+#ifdef HAVE_ALSA
+    &regulator_alsa_backend,
+#endif
+    NULL
+};
+
+const regulator_backend_t* regulator_find_backend(const char* name) {
+    for (size_t i = 0; regulator_backends[i]; i += 1) {
+        if (!strcmp(regulator_backends[i]->name, name)) {
+            return regulator_backends[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * --raw, or --file, or --backend, or PulseAudio.  --backend names a
+ * capture backend; the ones that read files are chosen by --file and
+ * --raw, which have the filename they need, and not along with it.
+ */
+const regulator_backend_t* regulator_choose_backend(struct regulator_t* rp) {
+    const regulator_backend_t* backend;
+    if (rp->backend_name != NULL) {
+        if (rp->raw_format || rp->filename != NULL) {
+            fprintf(stderr, "%s: --backend can't be used with --%s\n",
+                    rp->progname, rp->raw_format ? "raw" : "file");
+            exit(1);
+        }
+        if (!(backend = regulator_find_backend(rp->backend_name))) {
+            fprintf(stderr, "%s: unknown or unavailable backend: %s\n",
+                    rp->progname, rp->backend_name);
+            exit(1);
+        }
+        if (backend == &regulator_sndfile_backend ||
+            backend == &regulator_raw_backend) {
+            fprintf(stderr, "%s: the %s backend is chosen by --%s\n",
+                    rp->progname, backend->name,
+                    (backend == &regulator_raw_backend) ? "raw" : "file");
+            exit(1);
+        }
+        return backend;
+    }
+    if (rp->raw_format) {
+        return &regulator_raw_backend;
+    }
+    if (rp->filename != NULL) {
+        return &regulator_sndfile_backend;
+    }
+    return &regulator_pulseaudio_backend;
+}
+
+/**
+ * Out of data before the first batch of ticks is in: the end of a
+ * run of its own, but an embedded one's caller says so for it, and
+ * for the other clocks, whose results still stand.
+ */
+static int regulator_not_enough_data(struct regulator_t* rp) {
+    if (!rp->embedded) {
+        fprintf(stderr, "%s: not enough data\n", rp->progname);
+        exit(1);
+    }
+    return -1;
+}
+
+int regulator_read_first_batch_of_ticks(struct regulator_t* rp) {
     for (; rp->tick_count < TICKS_PER_GROUP; rp->tick_count += 1) {
         if (!regulator_read(rp, rp->samples_per_tick)) {
-            fprintf(stderr, "%s: not enough data\n", rp->progname);
-            exit(1);
+            return regulator_not_enough_data(rp);
         }
         regulator_process_tick(rp);
     }
+    return 0;
 }
 
 void regulator_analyze_first_batch_of_ticks(struct regulator_t* rp) {
@@ -40,12 +126,97 @@ void regulator_analyze_first_batch_of_ticks(struct regulator_t* rp) {
     }
 }
 
-/* after options are set */
-void regulator_run(struct regulator_t* rp) {
-    if (rp->filename == NULL) {
-        regulator_pulseaudio_open(rp);
-    } else {
-        regulator_sndfile_open(rp);
+/* the loudest sample's place in each of the first few ticks */
+static size_t regulator_progressive_phase(struct regulator_t* rp) {
+    size_t spt = rp->samples_per_tick;
+    size_t phases[PROGRESSIVE_PHASE_TICKS];
+    size_t best = 0;
+    size_t best_cost = SIZE_MAX;
+    size_t cost;
+    size_t d;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < PROGRESSIVE_PHASE_TICKS; i += 1) {
+        const int16_t* samples = rp->buffer + i * spt;
+        phases[i] = 0;
+        for (j = 1; j < spt; j += 1) {
+            if (samples[j] > samples[phases[i]]) {
+                phases[i] = j;
+            }
+        }
+    }
+    /* the median, going around: a tick can straddle two windows */
+    for (i = 0; i < PROGRESSIVE_PHASE_TICKS; i += 1) {
+        cost = 0;
+        for (j = 0; j < PROGRESSIVE_PHASE_TICKS; j += 1) {
+            d = (phases[i] > phases[j]) ?
+                phases[i] - phases[j] : phases[j] - phases[i];
+            cost += (d < spt - d) ? d : spt - d;
+        }
+        if (cost < best_cost) {
+            best_cost = cost;
+            best = phases[i];
+        }
+    }
+    return best;
+}
+
+/**
+ * --progressive: instead of reading TICKS_PER_GROUP ticks before
+ * looking at any, guess where the ticks fall from the first
+ * PROGRESSIVE_PHASE_TICKS, start each window half a tick before
+ * that, and show a provisional result after every tick of the
+ * first batch.  The realignment in regulator_run refines the
+ * windows from there, as it always does.
+ */
+int regulator_progressive_first_batch_of_ticks(struct regulator_t* rp) {
+    size_t spt = rp->samples_per_tick;
+    size_t phase;
+
+    for (size_t i = 0; i < PROGRESSIVE_PHASE_TICKS; i += 1) {
+        if (!regulator_read(rp, spt)) {
+            return regulator_not_enough_data(rp);
+        }
+        regulator_process_tick(rp);
+    }
+    phase = regulator_progressive_phase(rp);
+    rp->buffer_analyze = rp->buffer + (phase + spt - spt / 2) % spt;
+    if (rp->debug >= 2) {
+        printf("ticks at about %d samples; windows start at %d\n",
+               (int)phase, (int)(rp->buffer_analyze - rp->buffer));
+    }
+
+    while (rp->tick_count < TICKS_PER_GROUP) {
+        if (rp->buffer_analyze > rp->buffer_append - spt) {
+            if (!regulator_read(rp, spt)) {
+                return regulator_not_enough_data(rp);
+            }
+            regulator_process_tick(rp);
+            continue;
+        }
+        regulator_analyze_tick(rp);
+        rp->tick_count += 1;
+        if (!rp->embedded && rp->tick_peak_count >= 2) {
+            float drift = regulator_result(rp, 0);
+            printf("provisional, %d ticks: %f seconds %s\n",
+                   (int)rp->tick_count,
+                   (double)(drift < 0 ? -drift : drift),
+                   (drift < 0 ? "slow" : "fast"));
+        }
+    }
+    return 0;
+}
+
+/**
+ * After options are set.  Returns -1, having told no one, if an
+ * embedded run runs out of data before its first batch of ticks;
+ * anything else that goes wrong is the end of the process.
+ */
+int regulator_run(struct regulator_t* rp) {
+    if (rp->type == REGULATOR_TYPE_NONE) {
+        /* otherwise already opened, e.g., by regulator_multi_run */
+        regulator_choose_backend(rp)->open(rp);
     }
 
     if (rp->debug >= 2) {
@@ -55,9 +226,37 @@ void regulator_run(struct regulator_t* rp) {
         printf("%d sample buffer samples\n", (int)rp->sample_buffer_samples);
         printf("%d sample buffer bytes\n", (int)rp->sample_buffer_bytes);
         printf("%d bytes per frame\n", (int)rp->bytes_per_frame);
+        printf("%s backend\n", rp->backend->name);
+        if (rp->backend->latency) {
+            printf("%d frames capture latency\n",
+                   (int)rp->backend->latency(rp));
+        }
     }
 
-    rp->buffer_ticks = TICKS_PER_GROUP + 1;
+    rp->analyze_kernel = regulator_choose_kernel(rp);
+    if (rp->debug >= 2) {
+        if (rp->analyze_kernel == regulator_kernel_generic) {
+            printf("using generic peak finding kernel\n");
+        } else {
+            printf("using %d/%d peak finding kernel\n",
+                   (int)rp->frames_per_second, (int)rp->ticks_per_hour);
+        }
+    }
+
+    if (rp->timeline_filename) {
+        regulator_timeline_open(rp);
+    }
+    if (rp->socket_path) {
+        regulator_daemon_open(rp);
+    }
+    if (rp->trace_filename) {
+        regulator_trace_open(rp);
+    }
+    regulator_drift_open(rp);
+
+    /* --progressive's windows start up to a tick in, so its first
+       batch can take a tick more, and the retry still needs room */
+    rp->buffer_ticks = TICKS_PER_GROUP + (rp->progressive ? 2 : 1);
     rp->buffer_samples = rp->buffer_ticks * rp->samples_per_tick;
     rp->buffer = (int16_t*)malloc(sizeof(int16_t) * rp->buffer_samples);
     if (!rp->buffer) {
@@ -79,17 +278,43 @@ void regulator_run(struct regulator_t* rp) {
         perror(rp->progname);
         exit(1);
     }
+    if (rp->show_ticks) {
+        rp->tick_display =
+            (char*)malloc(1 + TICK_DISPLAY_LINES * TICK_DISPLAY_BINS);
+        if (!rp->tick_display) {
+            perror(rp->progname);
+            exit(1);
+        }
+    }
+    if (rp->realtime) {
+        regulator_realtime_open(rp);
+    }
 
     rp->tick_count = 0;
     rp->good_tick_count = 0;
     rp->tick_peak_count = 0;
     rp->boundary_peak_count = 0;
+    rp->quiet_tick_count = 0;
+    rp->ill_defined_tick_count = 0;
+    rp->peak_offset = 0;
+    regulator_precision_reset(rp);
+    memset(&(rp->gaps), 0, sizeof(regulator_gap_t));
 
-    regulator_sighandler_ptr = rp;
-    signal(SIGINT, regulator_sighandler);
+    if (!rp->embedded) {
+        regulator_sighandler_ptr = rp;
+        signal(SIGINT, regulator_sighandler);
+    }
 
-    regulator_read_first_batch_of_ticks(rp);
-    regulator_analyze_first_batch_of_ticks(rp);
+    if (rp->progressive) {
+        if (regulator_progressive_first_batch_of_ticks(rp)) {
+            return -1;
+        }
+    } else {
+        if (regulator_read_first_batch_of_ticks(rp)) {
+            return -1;
+        }
+        regulator_analyze_first_batch_of_ticks(rp);
+    }
 
     if (rp->boundary_peak_count >= (TICKS_PER_GROUP * 3 / 4)) {
         if (rp->debug >= 2) {
@@ -97,8 +322,7 @@ void regulator_run(struct regulator_t* rp) {
                    "shifting and trying again\n");
         }
         if (!regulator_read(rp, rp->samples_per_tick / 2)) {
-            fprintf(stderr, "%s: not enough data\n", rp->progname);
-            exit(1);
+            return regulator_not_enough_data(rp);
         }
         regulator_process_tick(rp);
         rp->buffer_analyze += rp->samples_per_tick / 2;
@@ -110,6 +334,15 @@ void regulator_run(struct regulator_t* rp) {
         rp->good_tick_count = 0;
         rp->tick_peak_count = 0;
         rp->boundary_peak_count = 0;
+        rp->quiet_tick_count = 0;
+        rp->ill_defined_tick_count = 0;
+        rp->peak_offset = 0;
+        if (rp->timeline) {
+            regulator_timeline_rewind(rp);
+        }
+        regulator_drift_reset(rp);
+        regulator_precision_reset(rp);
+        regulator_trace_reset(rp);
 
         regulator_analyze_first_batch_of_ticks(rp);
     }
@@ -119,12 +352,17 @@ void regulator_run(struct regulator_t* rp) {
         exit(1);
     }
 
+    /* nothing will be rewound from here on */
+    regulator_buffer_stream(rp);
+    regulator_realtime_steady(rp, 1);
+
     /* each a count of contiguous peaks */
     int early_peak_count = 0;
     int late_peak_count = 0;
 
-    /* max 1 hour of data */
-    for (; rp->tick_count < rp->ticks_per_hour; rp->tick_count += 1) {
+    /* max 1 hour of data, or on and on for --daemon */
+    for (; rp->tick_count < rp->ticks_per_hour || rp->daemon;
+         rp->tick_count += 1) {
 
         if (rp->this_tick_has_well_defined_peak) {
             if (rp->this_tick_peak <
@@ -172,10 +410,7 @@ void regulator_run(struct regulator_t* rp) {
                        (int)(rp->tick_count - 1),
                        (int)(rp->samples_per_tick - extra_samples));
             }
-            for (size_t i = 0; i < rp->tick_count; i += 1) {
-                rp->tick_peak_data[rp->tick_peak_count].peak +=
-                    rp->samples_per_tick - extra_samples;
-            }
+            rp->peak_offset += rp->samples_per_tick - extra_samples;
             early_peak_count = 0;
             late_peak_count = 0;
 
@@ -202,9 +437,7 @@ void regulator_run(struct regulator_t* rp) {
                        (int)(rp->tick_count - 1),
                        (int)(-extra_samples));
             }
-            for (size_t i = 0; i < rp->tick_count; i += 1) {
-                rp->tick_peak_data[rp->tick_peak_count].peak -= extra_samples;
-            }
+            rp->peak_offset -= extra_samples;
             early_peak_count = 0;
             late_peak_count = 0;
 
@@ -221,14 +454,35 @@ void regulator_run(struct regulator_t* rp) {
         }
 
         regulator_analyze_tick(rp);
+
+        if (rp->gaps.pending) {
+            regulator_gap_skip(rp);
+        }
+
+        if (rp->precision > 0 && regulator_precision_met(rp)) {
+            rp->tick_count += 1;
+            if (!rp->embedded) {
+                printf("+/-%g seconds per day reached after %d ticks "
+                       "(%.1f seconds)\n", rp->precision, (int)rp->tick_count,
+                       (double)rp->tick_count * rp->samples_per_tick /
+                       rp->frames_per_second);
+            }
+            break;
+        }
     }
-    signal(SIGINT, SIG_DFL);
-    regulator_show_result(rp, 0);
+    regulator_realtime_steady(rp, 0);
+    if (!rp->embedded) {
+        signal(SIGINT, SIG_DFL);
+        regulator_show_final_result(rp);
+        regulator_drift_save(rp);
+    }
+    return 0;
 }
 
 void regulator_sighandler(int signal) {
     putchar('\n');
-    regulator_show_result(regulator_sighandler_ptr, 0);
+    regulator_show_final_result(regulator_sighandler_ptr);
+    regulator_drift_save(regulator_sighandler_ptr);
     exit(0);
 }
 
@@ -238,8 +492,15 @@ float regulator_result(struct regulator_t* rp, size_t ticks) {
     }
 
     /* in samples per tick, -/+ fast/slow */
-    float drift = kt_best_fit(rp->tick_peak_data + rp->tick_peak_count - ticks,
-                              ticks);
+    float drift;
+    if (rp->rt && ticks <= REALTIME_FIT_TICKS) {
+        kt_best_fit_into(rp->tick_peak_data + rp->tick_peak_count - ticks,
+                         ticks, &drift, rp->rt->fit_slopes);
+    } else if (kt_best_fit(rp->tick_peak_data + rp->tick_peak_count - ticks,
+                           ticks, &drift)) {
+        perror(rp->progname);
+        exit(1);
+    }
 
     /* in seconds per day, -/+ slow/fast */
     drift = -drift / rp->frames_per_second * rp->ticks_per_hour * 24;
@@ -249,6 +510,9 @@ float regulator_result(struct regulator_t* rp, size_t ticks) {
 
 void regulator_show_result(struct regulator_t* rp, size_t ticks) {
     float drift = regulator_result(rp, ticks);
+    float low;
+    float high;
+    double ms;
     if (ticks) {
         printf("past %d data points: ", (int)ticks);
     } else {
@@ -257,63 +521,125 @@ void regulator_show_result(struct regulator_t* rp, size_t ticks) {
     printf("%f seconds %s\n",
            (double)(drift < 0 ? -drift : drift),
            (drift < 0 ? "slow" : "fast"));
+    /* not while --realtime is steady: it allocates, and takes a while */
+    if (rp->confidence > 0 && !(rp->rt && rp->rt->steady) &&
+        regulator_bootstrap(rp, ticks, drift, &low, &high, &ms)) {
+        printf("    %g%% confidence: %+f to %+f seconds per day "
+               "(%.1f ms)\n", rp->confidence, (double)low, (double)high, ms);
+    }
     if (!ticks) {
         if (rp->debug >= 1) {
             printf("%d good data points out of %d wanted\n",
-                   (int)rp->good_tick_count, (int)rp->tick_count);
+                   (int)rp->good_tick_count,
+                   (int)(rp->good_tick_count + rp->quiet_tick_count +
+                         rp->boundary_peak_count +
+                         rp->ill_defined_tick_count));
+            printf("%d below noise floor, %d at window boundary, "
+                   "%d without a clear peak\n",
+                   (int)rp->quiet_tick_count, (int)rp->boundary_peak_count,
+                   (int)rp->ill_defined_tick_count);
         }
     }
 }
 
+/**
+ * At the end of a run: the result over all the data, then each
+ * --drift-window's and the capture gaps, which --stats's result every
+ * 20 ticks leaves out.
+ */
+void regulator_show_final_result(struct regulator_t* rp) {
+    regulator_show_result(rp, 0);
+    regulator_drift_show(rp);
+    regulator_gap_show(rp);
+}
+
+/**
+ * --ticks: the last tick read, as TICK_DISPLAY_LINES bars, each the
+ * 95th percentile of its slice's samples to six bits.  Only the
+ * percentile's top six bits are shown, so a TICK_DISPLAY_BINS-bin
+ * histogram gives the same bar a sort would.  The whole frame goes
+ * out in one write(), at most --ticks-rate frames a second.
+ */
 void regulator_show_tick(struct regulator_t* rp) {
     int16_t* tick_start = rp->buffer_append - rp->samples_per_tick;
+    uint32_t histogram[TICK_DISPLAY_BINS];
+    struct timespec now;
+    char* p;
+    size_t seen;
+    size_t bin;
+    int16_t* start;
+    int16_t* end;
+    size_t size;
+
     if (tick_start < rp->buffer) {
         return;
     }
-    int lines = 20;
-    int16_t* temp =
-        (int16_t*)malloc(sizeof(int16_t*) *
-                         (rp->samples_per_tick / lines + 1));
-    if (!temp) {
-        perror(rp->progname);
-        exit(1);
-    }
-    putchar('\n');
-    for (size_t i = 0; i < (size_t)lines; i += 1) {
-        int16_t* start = tick_start + (rp->samples_per_tick *    i   ) / lines;
-        int16_t* end   = tick_start + (rp->samples_per_tick * (i + 1)) / lines;
-        size_t size = end - start;
+    if (rp->ticks_rate) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((now.tv_sec - rp->tick_display_time.tv_sec) * 1e9 +
+            (now.tv_nsec - rp->tick_display_time.tv_nsec) <
+            1e9 / rp->ticks_rate) {
+            return;
+        }
+        rp->tick_display_time = now;
+    }
+    p = rp->tick_display;
+    *p++ = '\n';
+    for (size_t i = 0; i < TICK_DISPLAY_LINES; i += 1) {
+        start = tick_start + (rp->samples_per_tick *    i   ) / TICK_DISPLAY_LINES;
+        end   = tick_start + (rp->samples_per_tick * (i + 1)) / TICK_DISPLAY_LINES;
+        size = end - start;
+        memset(histogram, 0, sizeof(histogram));
         for (size_t j = 0; j < size; j += 1) {
-            temp[j] = start[j];
+            histogram[start[j] >> (sizeof(int16_t) * 8 - 7)] += 1;
         }
-        qsort(temp, size, sizeof(int16_t), (qsort_function)int16_t_sort);
-
-        /* most significant six bits of 95th percentile maximum, so 0
-           to 63 */
-        int16_t ninety_fifth = temp[size * 95 / 100] /
-            (1 << (sizeof(int16_t) * 8 - 7));
-
-        for (int j = 0; j < ninety_fifth; j += 1) {
-            putchar('#');
+        seen = 0;
+        for (bin = 0; bin < TICK_DISPLAY_BINS - 1; bin += 1) {
+            seen += histogram[bin];
+            if (seen > size * 95 / 100) {
+                break;
+            }
         }
-        putchar('\n');
+        memset(p, '#', bin);
+        p += bin;
+        *p++ = '\n';
+    }
+
+    /* anything printf()ed goes first */
+    fflush(stdout);
+    for (char* q = rp->tick_display; q < p; ) {
+        ssize_t n = write(fileno(stdout), q, p - q);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        q += n;
     }
-    free(temp);
 }
 
 void regulator_cleanup(struct regulator_t* rp) {
+    regulator_daemon_close(rp);
+    regulator_realtime_close(rp);
+    regulator_trace_close(rp);
+    regulator_timeline_close(rp);
+    regulator_drift_close(rp);
     if (rp->tick_peak_data) {
         free(rp->tick_peak_data);
         rp->tick_peak_data = NULL;
     }
+    if (rp->tick_display) {
+        free(rp->tick_display);
+        rp->tick_display = NULL;
+    }
     if (rp->buffer) {
         free(rp->buffer);
         rp->buffer = NULL;
     }
-    if (rp->type == REGULATOR_TYPE_PULSEAUDIO) {
-        regulator_pulseaudio_close(rp);
-    } else if (rp->type == REGULATOR_TYPE_SNDFILE) {
-        regulator_sndfile_close(rp);
+    if (rp->backend) {
+        rp->backend->close(rp);
+        rp->backend = NULL;
     }
     rp->type = REGULATOR_TYPE_NONE;
 }
@@ -449,6 +775,55 @@ void regulator_buffer_rewind_by(struct regulator_t* rp, size_t samples) {
     rp->buffer_analyze -= samples;
 }
 
+/**
+ * How much of the buffer can go when it fills up: everything but the
+ * tick before buffer_analyze, which a window moved back for early
+ * peaks can still reach.  While the first batch of ticks may yet be
+ * rewound, the buffer holds all of it and never fills.
+ */
+static size_t regulator_buffer_droppable(struct regulator_t* rp) {
+    if (rp->buffer_analyze - rp->buffer <= (ssize_t)rp->samples_per_tick) {
+        return 0;
+    }
+    return rp->buffer_analyze - rp->buffer - rp->samples_per_tick;
+}
+
+/**
+ * Once the first batch of ticks is done, shrink the buffer to
+ * STREAM_BUFFER_TICKS: enough for the tick behind buffer_analyze,
+ * what hasn't been analyzed yet, and the next read, with room to
+ * spare so that it's compacted only every few ticks.
+ */
+void regulator_buffer_stream(struct regulator_t* rp) {
+    size_t drop = regulator_buffer_droppable(rp);
+    size_t samples = STREAM_BUFFER_TICKS * rp->samples_per_tick;
+    size_t analyze;
+    size_t append;
+    int16_t* buffer;
+
+    regulator_buffer_shift_left_by(rp, drop);
+    if (rp->buffer_samples <= samples ||
+        (size_t)(rp->buffer_append - rp->buffer) > samples) {
+        return;
+    }
+    analyze = rp->buffer_analyze - rp->buffer;
+    append  = rp->buffer_append - rp->buffer;
+    if (!(buffer = (int16_t*)realloc(rp->buffer, sizeof(int16_t) * samples))) {
+        perror(rp->progname);
+        exit(1);
+    }
+    rp->buffer         = buffer;
+    rp->buffer_ticks   = STREAM_BUFFER_TICKS;
+    rp->buffer_samples = samples;
+    rp->buffer_end     = buffer + samples;
+    rp->buffer_analyze = buffer + analyze;
+    rp->buffer_append  = buffer + append;
+    if (rp->debug >= 2) {
+        printf("%d ticks in sample data block from here on\n",
+               (int)rp->buffer_ticks);
+    }
+}
+
 size_t regulator_read(struct regulator_t* rp, size_t samples) {
     if (!samples) {
         return 1;
@@ -459,96 +834,57 @@ size_t regulator_read(struct regulator_t* rp, size_t samples) {
         if (rp->debug >= 2) {
             printf("not enough to read %d samples\n", (int)samples);
         }
-        regulator_buffer_shift_left_by(
-            rp, samples - (rp->buffer_end - rp->buffer_append)
-        );
+        /* ...drop all that's done with, not just what's needed, so
+           the rest is moved once every few ticks and not every tick */
+        size_t drop = regulator_buffer_droppable(rp);
+        size_t need = samples - (rp->buffer_end - rp->buffer_append);
+        regulator_buffer_shift_left_by(rp, drop > need ? drop : need);
     }
-    if (rp->filename == NULL) {
-        samples_read =
-            regulator_pulseaudio_read(rp, rp->buffer_append, samples);
-    } else {
-        samples_read =
-            regulator_sndfile_read(rp, rp->buffer_append, samples);
+    samples_read = rp->backend->read(rp, rp->buffer_append, samples);
+    if (rp->backend->latency) {
+        regulator_gap_check(rp, samples_read);
     }
     rp->buffer_append += samples;
     return samples_read == samples;
 }
 
+/* we want the amplitude, not the sign */
+void regulator_rectify_samples(int16_t* samples, size_t count) {
+    size_t i;
+    for (i = 0; i < count; i += 1) {
+        if (samples[i] == INT16_MIN) { /* -32768 => 32767 */
+            samples[i] = INT16_MAX;
+        } else if (samples[i] < 0) {
+            samples[i] = -samples[i];
+        }
+    }
+}
+
+/* what each backend does with channel 0 once it has it, signed */
+void regulator_rectify(struct regulator_t* rp, int16_t* samples, size_t count) {
+    if (regulator_filter_enabled(rp)) {
+        regulator_filter_run(rp, samples, count);
+    }
+    regulator_rectify_samples(samples, count);
+}
+
 /* mainly to find the peak */
 void regulator_analyze_tick(struct regulator_t* rp) {
-    size_t peak_sample_indexes[PEAK_SAMPLES];
-    size_t index;
-    size_t low_indexes = 0;
-    size_t high_indexes = 0;
-
     if (!rp->sample_sort_buffer) {
         return;
     }
 
-    for (size_t i = 0; i < rp->samples_per_tick; i += 1) {
-        rp->sample_sort_buffer[i].sample = rp->buffer_analyze[i];
-        rp->sample_sort_buffer[i].index = i;
-    }
-
-    rp->buffer_analyze += rp->samples_per_tick;
-
-    qsort(rp->sample_sort_buffer,
-          rp->samples_per_tick,
-          sizeof(regulator_sample_t),
-          (qsort_function)sample_sort);
-
-    for (size_t i = 0; i < PEAK_SAMPLES; i += 1) {
-        index = rp->sample_sort_buffer[i].index;
-        peak_sample_indexes[i] = index;
-        if (index <
-            (rp->samples_per_tick * PEAK_WAY_OFF_THRESHOLD_1 / PEAK_SAMPLES)) {
-            low_indexes += 1;
-        } else if ((rp->samples_per_tick - index) <=
-            (rp->samples_per_tick * PEAK_WAY_OFF_THRESHOLD_1 / PEAK_SAMPLES)) {
-            high_indexes += 1;
-        }
-    }
-
-    /* heuristic */
-    rp->this_tick_peak_at_boundary = (
-        (low_indexes >= (PEAK_WAY_OFF_THRESHOLD_2) &&
-         high_indexes >= (PEAK_WAY_OFF_THRESHOLD_2)) ||
-        low_indexes >= (PEAK_WAY_OFF_THRESHOLD_2 * 2) ||
-        high_indexes >= (PEAK_WAY_OFF_THRESHOLD_2 * 2)
-    );
-
-    qsort(peak_sample_indexes, PEAK_SAMPLES, sizeof(size_t),
-          (qsort_function)size_t_sort);
-    size_t lowest_index  =
-        peak_sample_indexes[PEAK_WAY_OFF_THRESHOLD_2];
-    size_t highest_index =
-        peak_sample_indexes[PEAK_SAMPLES - 1 - PEAK_WAY_OFF_THRESHOLD_2];
-    rp->this_tick_has_well_defined_peak =
-        ((highest_index - lowest_index) <
-         rp->samples_per_tick * PEAK_WAY_OFF_THRESHOLD_1 / PEAK_SAMPLES);
-    if (rp->this_tick_has_well_defined_peak) {
-        rp->this_tick_peak = (highest_index + lowest_index) / 2;
-        if (rp->this_tick_peak <
-            rp->samples_per_tick * SHIFT_POINT_PERCENT / 100) {
-            rp->this_tick_has_early_peak = 1;
-            rp->this_tick_has_late_peak = 0;
-        } else if (rp->this_tick_peak >=
-                   rp->samples_per_tick * (100 - SHIFT_POINT_PERCENT) / 100) {
-            rp->this_tick_has_early_peak = 0;
-            rp->this_tick_has_late_peak = 1;
-        } else {
-            rp->this_tick_has_early_peak = 0;
-            rp->this_tick_has_late_peak = 0;
-        }
-    } else {
-        rp->this_tick_peak = SIZE_MAX;
-    }
+    rp->analyze_kernel(rp);
 
     if (rp->this_tick_peak_at_boundary) {
         rp->boundary_peak_count += 1;
     } else if (rp->this_tick_has_well_defined_peak) {
+        if (rp->server && rp->tick_peak_count == rp->ticks_per_hour) {
+            regulator_daemon_rollover(rp);
+        }
         rp->tick_peak_data[rp->tick_peak_count].index = rp->tick_count;
-        rp->tick_peak_data[rp->tick_peak_count].peak = rp->this_tick_peak;
+        rp->tick_peak_data[rp->tick_peak_count].peak =
+            (ssize_t)rp->this_tick_peak - rp->peak_offset;
         if (rp->debug >= 2) {
             printf("data point # %6d: %6d at tick # %6d\n",
                    (int)rp->tick_peak_count,
@@ -557,12 +893,35 @@ void regulator_analyze_tick(struct regulator_t* rp) {
         }
         rp->tick_peak_count += 1;
         rp->good_tick_count += 1;
+        if (rp->drift_window_count) {
+            regulator_drift_add(rp);
+        }
+        if (rp->precision > 0) {
+            regulator_precision_add(rp);
+        }
+    } else if (rp->this_tick_is_quiet) {
+        rp->quiet_tick_count += 1;
+        if (rp->debug >= 2) {
+            printf("nothing above noise floor at tick # %6d\n",
+                   (int)rp->tick_count);
+        }
     } else {
+        rp->ill_defined_tick_count += 1;
         if (rp->debug >= 2) {
             printf("data not good enough at tick # %6d\n",
                    (int)rp->tick_count);
         }
     }
+
+    if (rp->timeline) {
+        regulator_timeline_append(rp);
+    }
+    if (rp->trace) {
+        regulator_trace_add(rp);
+    }
+    if (rp->server) {
+        regulator_daemon_publish(rp);
+    }
 }
 
 void regulator_process_tick(regulator_t* rp) {
@@ -581,71 +940,8 @@ void regulator_process_tick(regulator_t* rp) {
         if (rp->tick_count >= 40 && rp->tick_count % 20 == 0) {
             putchar('\n');
             regulator_show_result(rp, 20);
-            regulator_show_result(rp, 0);
+            /* --realtime has room to fit only so many */
+            regulator_show_result(rp, rp->rt ? REALTIME_FIT_TICKS : 0);
         }
     }
 }
-
-/**
- * Kendall-Thiel best fit.  Mainly so outliers affect the results less.
- */
-float kt_best_fit(tick_peak_t* data, size_t ticks) {
-    if (ticks < 2) {
-        return 0;
-    }
-    size_t nslopes = ((ticks * (ticks - 1)) / 2);
-    float* slopes = (float*)malloc(sizeof(float) * nslopes);
-    if (!slopes) {
-        perror(progname);
-        exit(1);
-    }
-    size_t si = 0;
-    for (size_t i = 0; i < ticks - 1; i += 1) {
-        for (size_t j = i + 1; j < ticks; j += 1) {
-            slopes[si] = (0.0f + data[j].peak - data[i].peak) /
-                (0.0f + data[j].index - data[i].index);
-            si += 1;
-        }
-    }
-    qsort(slopes, nslopes, sizeof(float), (qsort_function)float_sort);
-
-    /* median */
-    float result;
-    if (nslopes % 2 == 0) {
-        result = (slopes[nslopes / 2] + slopes[nslopes / 2 - 1]) / 2;
-    } else {
-        result = slopes[nslopes / 2];
-    }
-
-    free(slopes);
-    return result;
-}
-
-/**
- * For sampling magnitude-index sample pairs in decreasing order of
- * magnitude, to find peaks.
- */
-int sample_sort(const regulator_sample_t* a, const regulator_sample_t* b) {
-    return (a->sample < b->sample) ? 1 : (a->sample > b->sample) ? -1 : 0;
-}
-
-/**
- * Helper function for peak finding.
- */
-int size_t_sort(const size_t* a, const size_t* b) {
-    return (*a < *b) ? -1 : (*a > *b) ? 1 : 0;
-}
-
-/**
- * Helper function for displaying ticks.
- */
-int int16_t_sort(const int16_t* a, const int16_t* b) {
-    return (*a < *b) ? -1 : (*a > *b) ? 1 : 0;
-}
-
-/**
- * Helper function for best fit.
- */
-int float_sort(const float* a, const float* b) {
-    return (*a < *b) ? -1 : (*a > *b) ? 1 : 0;
-}
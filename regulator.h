@@ -11,13 +11,22 @@
 #define PEAK_WAY_OFF_THRESHOLD_1 (PEAK_SAMPLES * 5 / 100)
 #define PEAK_WAY_OFF_THRESHOLD_2 (PEAK_SAMPLES * 5 / 100)
 #define SHIFT_POINT_PERCENT      10
+#define TICK_DISPLAY_LINES       20
+#define TICK_DISPLAY_BINS        64
+#define PROGRESSIVE_PHASE_TICKS  3
+#define STREAM_BUFFER_TICKS      8
 
 char* regulator_set_progname(struct regulator_t* rp,
                              int argc, char* const argv[]);
-void regulator_run(struct regulator_t* rp);
+const regulator_backend_t* regulator_find_backend(const char* name);
+const regulator_backend_t* regulator_choose_backend(struct regulator_t* rp);
+int regulator_run(struct regulator_t* rp);
 void regulator_cleanup(struct regulator_t* rp);
 size_t regulator_read(struct regulator_t* rp, size_t samples);
+void regulator_rectify_samples(int16_t* samples, size_t count);
+void regulator_rectify(struct regulator_t* rp, int16_t* samples, size_t count);
 void regulator_analyze_tick(struct regulator_t* rp);
+int regulator_progressive_first_batch_of_ticks(struct regulator_t* rp);
 void regulator_usage(struct regulator_t* rp);
 void regulator_options(struct regulator_t* rp,
                        int* argcp, char* const** argvp);
@@ -32,32 +41,16 @@ int regulator_buffer_can_shift_left_to_have(struct regulator_t* rp,
 int regulator_buffer_can_rewind_by(struct regulator_t* rp, size_t samples);
 void regulator_buffer_rewind_by(struct regulator_t* rp, size_t samples);
 void regulator_buffer_rewind_max_ticks(struct regulator_t* rp);
+void regulator_buffer_stream(struct regulator_t* rp);
 void regulator_show_tick(struct regulator_t* rp);
 void regulator_process_tick(struct regulator_t* rp);
+float regulator_result(struct regulator_t* rp, size_t ticks);
 void regulator_show_result(struct regulator_t* rp, size_t ticks);
+void regulator_show_final_result(struct regulator_t* rp);
 void regulator_sighandler(int signal);
 
-float kt_best_fit(tick_peak_t* data, size_t ticks);
-
-int sample_sort(const regulator_sample_t* a, const regulator_sample_t* b);
-int size_t_sort(const size_t* a, const size_t* b);
-int int16_t_sort(const int16_t* a, const int16_t* b);
-int float_sort(const float* a, const float* b);
-
-/* You are not expected to understand this. */
-/* You are not guaranteed to be able to use this in an #if. */
-#ifdef REGULATOR_C
-int16_t _endian_test = 0x0001;
-#else
-extern int16_t _endian_test;
-#endif
-#define IS_LITTLE_ENDIAN (*((char*)&_endian_test))
-
-#ifdef REGULATOR_C
-char *progname;
-#else
-extern char* progname;
-#endif
+/* no process-wide state, so that libregulator can run many at once */
+#define IS_LITTLE_ENDIAN (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
 
 typedef int(*qsort_function)(const void*, const void*);
 
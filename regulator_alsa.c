@@ -0,0 +1,262 @@
+/**
+ * regulator_alsa.c --- direct ALSA capture, read out of the mmap area
+ *
+ * Copyright (C) 2019 Darren Embry.  GPL2.
+ */
+
+#define REGULATOR_ALSA_C
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+
+#include <alsa/asoundlib.h>
+
+#include "regulator.h"
+#include "regulator_alsa.h"
+#include "regulator_record.h"
+
+static void regulator_alsa_fail(struct regulator_t* rp,
+                                const char* what, int err) {
+    fprintf(stderr, "%s: %s failed: %s\n",
+            rp->progname, what, snd_strerror(err));
+    exit(1);
+}
+
+void regulator_alsa_open(struct regulator_t* rp) {
+    rp->type = REGULATOR_TYPE_ALSA;
+    rp->backend = &regulator_alsa_backend;
+    regulator_alsa_t alsa = {
+        .rate     = 44100,
+        .channels = 1
+    };
+    rp->implementation.alsa = alsa;
+    regulator_alsa_t *ip = &(rp->implementation.alsa);
+    const char* device = rp->device ? rp->device : "default";
+    snd_pcm_hw_params_t* hw;
+    snd_pcm_sw_params_t* sw;
+    snd_pcm_uframes_t buffer_frames;
+    int err;
+
+    if ((err = snd_pcm_open(&(ip->pcm), device,
+                            SND_PCM_STREAM_CAPTURE, 0)) < 0) {
+        fprintf(stderr, "%s: unable to open %s: %s\n",
+                rp->progname, device, snd_strerror(err));
+        exit(1);
+    }
+
+    if (!rp->ticks_per_hour) {
+        rp->ticks_per_hour = 3600; /* default */
+    }
+
+    if ((err = snd_pcm_hw_params_malloc(&hw)) < 0) {
+        regulator_alsa_fail(rp, "snd_pcm_hw_params_malloc", err);
+    }
+    if ((err = snd_pcm_hw_params_any(ip->pcm, hw)) < 0) {
+        regulator_alsa_fail(rp, "snd_pcm_hw_params_any", err);
+    }
+    if ((err = snd_pcm_hw_params_set_access(ip->pcm, hw,
+                                            SND_PCM_ACCESS_MMAP_INTERLEAVED))
+        < 0) {
+        regulator_alsa_fail(rp, "mmap access", err);
+    }
+    if ((err = snd_pcm_hw_params_set_format(ip->pcm, hw,
+                                            SND_PCM_FORMAT_S16)) < 0) {
+        regulator_alsa_fail(rp, "16-bit samples", err);
+    }
+    if ((err = snd_pcm_hw_params_set_channels_near(ip->pcm, hw,
+                                                   &(ip->channels))) < 0) {
+        regulator_alsa_fail(rp, "snd_pcm_hw_params_set_channels_near", err);
+    }
+    if ((err = snd_pcm_hw_params_set_rate_near(ip->pcm, hw,
+                                               &(ip->rate), NULL)) < 0) {
+        regulator_alsa_fail(rp, "snd_pcm_hw_params_set_rate_near", err);
+    }
+
+    if (!rp->block_ms) {
+        if ((3600 * ip->rate) % rp->ticks_per_hour) {
+            fprintf(stderr,
+                    "%s: can't process --ticks-per-hour=%d, "
+                    "sample rate is %d/sec\n",
+                    rp->progname, (int)rp->ticks_per_hour, ip->rate);
+            exit(1);
+        }
+        rp->samples_per_tick = 3600 * ip->rate / rp->ticks_per_hour;
+    }
+
+    /* one period per tick (or block), as with PulseAudio's fragsize */
+    ip->period_frames = rp->block_ms ?
+        ip->rate * rp->block_ms / 1000 : rp->samples_per_tick;
+    if ((err = snd_pcm_hw_params_set_period_size_near(ip->pcm, hw,
+                                                      &(ip->period_frames),
+                                                      NULL)) < 0) {
+        regulator_alsa_fail(rp, "snd_pcm_hw_params_set_period_size_near", err);
+    }
+    buffer_frames = ip->period_frames * ALSA_PERIODS_PER_BUFFER;
+    if ((err = snd_pcm_hw_params_set_buffer_size_near(ip->pcm, hw,
+                                                      &buffer_frames)) < 0) {
+        regulator_alsa_fail(rp, "snd_pcm_hw_params_set_buffer_size_near", err);
+    }
+    if ((err = snd_pcm_hw_params(ip->pcm, hw)) < 0) {
+        regulator_alsa_fail(rp, "snd_pcm_hw_params", err);
+    }
+    snd_pcm_hw_params_free(hw);
+
+    if ((err = snd_pcm_sw_params_malloc(&sw)) < 0) {
+        regulator_alsa_fail(rp, "snd_pcm_sw_params_malloc", err);
+    }
+    if ((err = snd_pcm_sw_params_current(ip->pcm, sw)) < 0) {
+        regulator_alsa_fail(rp, "snd_pcm_sw_params_current", err);
+    }
+    if ((err = snd_pcm_sw_params_set_avail_min(ip->pcm, sw,
+                                               ip->period_frames)) < 0) {
+        regulator_alsa_fail(rp, "snd_pcm_sw_params_set_avail_min", err);
+    }
+    if ((err = snd_pcm_sw_params(ip->pcm, sw)) < 0) {
+        regulator_alsa_fail(rp, "snd_pcm_sw_params", err);
+    }
+    snd_pcm_sw_params_free(sw);
+
+    rp->sample_buffer_frames  = rp->block_ms ?
+        ip->rate * rp->block_ms / 1000 : rp->samples_per_tick;
+    rp->sample_buffer_samples = rp->sample_buffer_frames * ip->channels;
+    rp->sample_buffer_bytes   = rp->sample_buffer_samples * sizeof(int16_t);
+    rp->bytes_per_frame       = ip->channels * sizeof(int16_t);
+    rp->frames_per_second     = ip->rate;
+
+    if (!rp->no_sample_sort_buffer) {
+        if (!(rp->sample_sort_buffer =
+              (regulator_sample_t*)
+              malloc(PEAK_SAMPLES * sizeof(regulator_sample_t)))) {
+            perror(rp->progname);
+            exit(1);
+        }
+    }
+
+    if (rp->record_filename) {
+        regulator_record_open(rp, ip->channels);
+    }
+
+    if ((err = snd_pcm_start(ip->pcm)) < 0) {
+        regulator_alsa_fail(rp, "snd_pcm_start", err);
+    }
+}
+
+void regulator_alsa_close(struct regulator_t* rp) {
+    regulator_alsa_t *ip = &(rp->implementation.alsa);
+    regulator_record_close(rp);
+    if (ip->xruns) {
+        fprintf(stderr, "%s: warning: %d capture overruns\n",
+                rp->progname, (int)ip->xruns);
+    }
+    if (rp->sample_sort_buffer) {
+        free(rp->sample_sort_buffer);
+        rp->sample_sort_buffer = NULL;
+    }
+    if (ip->pcm) {
+        snd_pcm_close(ip->pcm);
+        ip->pcm = NULL;
+    }
+    regulator_alsa_t alsa = {};
+    rp->implementation.alsa = alsa;
+}
+
+static void regulator_alsa_recover(struct regulator_t* rp, int err) {
+    regulator_alsa_t *ip = &(rp->implementation.alsa);
+    ip->xruns += 1;
+    if (rp->debug >= 2) {
+        printf("capture overrun: %s\n", snd_strerror(err));
+    }
+    if ((err = snd_pcm_recover(ip->pcm, err, 1)) < 0) {
+        regulator_alsa_fail(rp, "snd_pcm_recover", err);
+    }
+    /* prepared again after an overrun; a resume or an EINTR leaves
+       it running, and starting it then would fail */
+    if (snd_pcm_state(ip->pcm) == SND_PCM_STATE_PREPARED &&
+        (err = snd_pcm_start(ip->pcm)) < 0) {
+        regulator_alsa_fail(rp, "snd_pcm_start", err);
+    }
+}
+
+#define CHANNEL_NUMBER 0
+
+/**
+ * Copy channel 0 straight out of the driver's ring buffer into ours,
+ * and rectify the copy; there is no sound server and no intermediate
+ * read buffer.
+ */
+size_t regulator_alsa_read(struct regulator_t* rp,
+                           int16_t* buffer, size_t samples) {
+    regulator_alsa_t *ip = &(rp->implementation.alsa);
+    const snd_pcm_channel_area_t* areas;
+    snd_pcm_uframes_t offset;
+    snd_pcm_uframes_t frames;
+    snd_pcm_sframes_t avail;
+    snd_pcm_sframes_t committed;
+    size_t done = 0;
+    size_t i;
+    size_t step;
+    const int16_t* src;
+    int err;
+
+    while (done < samples) {
+        if ((avail = snd_pcm_avail_update(ip->pcm)) < 0) {
+            regulator_alsa_recover(rp, (int)avail);
+            continue;
+        }
+        if (avail == 0) {
+            if ((err = snd_pcm_wait(ip->pcm, 1000)) < 0) {
+                regulator_alsa_recover(rp, err);
+            }
+            continue;
+        }
+        frames = samples - done;
+        if (frames > (snd_pcm_uframes_t)avail) {
+            frames = avail;
+        }
+        if ((err = snd_pcm_mmap_begin(ip->pcm, &areas, &offset, &frames)) < 0) {
+            regulator_alsa_recover(rp, err);
+            continue;
+        }
+
+        /* interleaved, so every channel of these frames is together */
+        regulator_record_push(rp, (const int16_t*)
+                              ((const char*)areas[0].addr +
+                               (areas[0].first + offset * areas[0].step) / 8),
+                              frames);
+
+        step = areas[CHANNEL_NUMBER].step / 16;
+        src = (const int16_t*)
+            ((const char*)areas[CHANNEL_NUMBER].addr +
+             (areas[CHANNEL_NUMBER].first +
+              offset * areas[CHANNEL_NUMBER].step) / 8);
+        for (i = 0; i < frames; i += 1) {
+            buffer[done + i] = src[i * step];
+        }
+        regulator_rectify(rp, buffer + done, frames);
+
+        committed = snd_pcm_mmap_commit(ip->pcm, offset, frames);
+        if (committed < 0 || (snd_pcm_uframes_t)committed != frames) {
+            regulator_alsa_recover(rp, committed < 0 ? (int)committed : -EPIPE);
+        }
+        done += frames;
+    }
+    return done;
+}
+
+size_t regulator_alsa_latency(struct regulator_t* rp) {
+    regulator_alsa_t *ip = &(rp->implementation.alsa);
+    snd_pcm_sframes_t delay;
+    if (snd_pcm_delay(ip->pcm, &delay) < 0 || delay < 0) {
+        return 0;
+    }
+    return (size_t)delay;
+}
+
+const regulator_backend_t regulator_alsa_backend = {
+    .name    = "alsa",
+    .open    = regulator_alsa_open,
+    .read    = regulator_alsa_read,
+    .close   = regulator_alsa_close,
+    .latency = regulator_alsa_latency
+};
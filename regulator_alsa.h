@@ -0,0 +1,18 @@
+#ifndef REGULATOR_ALSA_H
+#define REGULATOR_ALSA_H
+
+#include <unistd.h>
+
+#include "regulator_types.h"
+
+#define ALSA_PERIODS_PER_BUFFER 4
+
+void regulator_alsa_open(struct regulator_t* rp);
+void regulator_alsa_close(struct regulator_t* rp);
+size_t regulator_alsa_read(struct regulator_t* rp,
+                           int16_t* ptr, size_t samples);
+size_t regulator_alsa_latency(struct regulator_t* rp);
+
+extern const regulator_backend_t regulator_alsa_backend;
+
+#endif  /* REGULATOR_ALSA_H */
@@ -0,0 +1,74 @@
+#ifndef REGULATOR_BACKEND_TYPES_H
+#define REGULATOR_BACKEND_TYPES_H
+
+#include <stdint.h>
+#include <unistd.h>
+#include <sndfile.h>
+#include <pulse/simple.h>
+#include <pulse/error.h>
+#include <pulse/pulseaudio.h>
+#ifdef HAVE_ALSA
+#include <alsa/asoundlib.h>
+#endif
+
+typedef struct regulator_sndfile_t {
+    SNDFILE* sf;
+    SF_INFO sfinfo;
+    int* sf_sample_buffer;
+
+    /* --cache hit: rectified channel 0, straight from the cache file */
+    void*          cache_map;
+    size_t         cache_map_size;
+    const int16_t* cache_samples;
+    size_t         cache_frames;
+    size_t         cache_pos;
+
+    /* FLAC, Ogg: chunks decoded ahead on other threads */
+    size_t                     decode_threads;
+    struct regulator_decode_t* decode;
+} regulator_sndfile_t;
+
+typedef struct regulator_pulseaudio_t {
+    pa_simple* pa_s;
+    int pa_error;
+    pa_sample_spec pa_ss;
+    pa_buffer_attr pa_ba;
+} regulator_pulseaudio_t;
+
+typedef struct regulator_raw_t {
+    int fd;
+    int close_fd;
+    regulator_raw_format_t format;
+    size_t rate;
+    size_t channels;
+    size_t bytes_per_sample;
+    int direct;                 /* read straight into the analysis buffer */
+    char* raw_buffer;
+} regulator_raw_t;
+
+#ifdef HAVE_ALSA
+typedef struct regulator_alsa_t {
+    snd_pcm_t* pcm;
+    unsigned int rate;
+    unsigned int channels;
+    snd_pcm_uframes_t period_frames;
+    size_t xruns;
+} regulator_alsa_t;
+#endif
+
+/* one source of a "multi" run; see regulator_multi.c */
+typedef struct regulator_stream_t {
+    struct regulator_multi_stream_t* ms;
+} regulator_stream_t;
+
+typedef union regulator_implementation_t {
+    regulator_pulseaudio_t pulseaudio;
+    regulator_sndfile_t    sndfile;
+    regulator_stream_t     stream;
+    regulator_raw_t        raw;
+#ifdef HAVE_ALSA
+    regulator_alsa_t       alsa;
+#endif
+} regulator_implementation_t;
+
+#endif  /* REGULATOR_BACKEND_TYPES_H */
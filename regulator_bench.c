@@ -0,0 +1,262 @@
+/**
+ * regulator_bench.c --- "regulator bench": the peak finding kernels
+ * on synthetic ticks
+ *
+ * Copyright (C) 2019 Darren Embry.  GPL2.
+ */
+
+#define REGULATOR_BENCH_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "regulator.h"
+#include "regulator_kernels.h"
+#include "regulator_bench.h"
+
+static double regulator_bench_time(struct regulator_t* rp,
+                                   regulator_kernel_t kernel,
+                                   int16_t* samples, size_t ticks,
+                                   size_t* checksum) {
+    struct timespec start;
+    struct timespec end;
+    double ns;
+    double best = 0;
+    size_t i;
+    int pass;
+
+    /* best of a few passes; the first also warms the cache */
+    for (pass = 0; pass < BENCH_PASSES; pass += 1) {
+        *checksum = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        rp->buffer_analyze = samples;
+        for (i = 0; i < ticks; i += 1) {
+            kernel(rp);
+            *checksum = *checksum * 31 + rp->this_tick_peak;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        ns = ((end.tv_sec - start.tv_sec) * 1e9 +
+              (end.tv_nsec - start.tv_nsec)) / ticks;
+        if (pass == 0 || ns < best) {
+            best = ns;
+        }
+    }
+    return best;
+}
+
+/**
+ * Peak finding as it was before the kernels: every sample of the
+ * window sorted, loudest first, ties going to the earlier sample as
+ * glibc's qsort, a merge sort, left them.  sorted has room for a
+ * window.  The kernels must find what this finds, tie for tie.
+ */
+static int regulator_bench_sample_sort(const regulator_sample_t* a,
+                                       const regulator_sample_t* b) {
+    return (a->sample < b->sample) ? 1 : (a->sample > b->sample) ? -1 :
+        (a->index > b->index) ? 1 : (a->index < b->index) ? -1 : 0;
+}
+
+static int regulator_bench_size_t_sort(const size_t* a, const size_t* b) {
+    return (*a < *b) ? -1 : (*a > *b) ? 1 : 0;
+}
+
+static void regulator_bench_reference(struct regulator_t* rp,
+                                      regulator_sample_t* sorted) {
+    size_t spt = rp->samples_per_tick;
+    size_t way_off = spt * PEAK_WAY_OFF_THRESHOLD_1 / PEAK_SAMPLES;
+    size_t peak_sample_indexes[PEAK_SAMPLES];
+    size_t low_indexes = 0;
+    size_t high_indexes = 0;
+    size_t index;
+    size_t i;
+
+    for (i = 0; i < spt; i += 1) {
+        sorted[i].sample = rp->buffer_analyze[i];
+        sorted[i].index = i;
+    }
+    qsort(sorted, spt, sizeof(regulator_sample_t),
+          (qsort_function)regulator_bench_sample_sort);
+    for (i = 0; i < PEAK_SAMPLES; i += 1) {
+        index = peak_sample_indexes[i] = sorted[i].index;
+        if (index < way_off) {
+            low_indexes += 1;
+        } else if ((spt - index) <= way_off) {
+            high_indexes += 1;
+        }
+    }
+    rp->this_tick_peak_at_boundary = (
+        (low_indexes >= (PEAK_WAY_OFF_THRESHOLD_2) &&
+         high_indexes >= (PEAK_WAY_OFF_THRESHOLD_2)) ||
+        low_indexes >= (PEAK_WAY_OFF_THRESHOLD_2 * 2) ||
+        high_indexes >= (PEAK_WAY_OFF_THRESHOLD_2 * 2)
+    );
+    qsort(peak_sample_indexes, PEAK_SAMPLES, sizeof(size_t),
+          (qsort_function)regulator_bench_size_t_sort);
+    size_t lowest_index  =
+        peak_sample_indexes[PEAK_WAY_OFF_THRESHOLD_2];
+    size_t highest_index =
+        peak_sample_indexes[PEAK_SAMPLES - 1 - PEAK_WAY_OFF_THRESHOLD_2];
+    rp->this_tick_has_well_defined_peak =
+        ((highest_index - lowest_index) < way_off);
+    if (rp->this_tick_has_well_defined_peak) {
+        rp->this_tick_peak = (highest_index + lowest_index) / 2;
+        rp->this_tick_has_early_peak =
+            (rp->this_tick_peak < spt * SHIFT_POINT_PERCENT / 100);
+        rp->this_tick_has_late_peak =
+            (rp->this_tick_peak >= spt * (100 - SHIFT_POINT_PERCENT) / 100);
+    } else {
+        rp->this_tick_peak = SIZE_MAX;
+    }
+}
+
+/**
+ * Ticks on which kernel and the reference disagree.  The noise gate
+ * is kept warming up, so that every window is looked at, as the
+ * reference looks at every window.
+ */
+static size_t regulator_bench_check(struct regulator_t* rp,
+                                    regulator_kernel_t kernel,
+                                    const int16_t* samples, size_t ticks,
+                                    regulator_sample_t* sorted) {
+    size_t differ = 0;
+    size_t peak;
+    size_t i;
+    int boundary;
+    int defined;
+    int early;
+    int late;
+
+    for (i = 0; i < ticks; i += 1) {
+        memset(&(rp->noise), 0, sizeof(regulator_noise_t));
+        rp->buffer_analyze = (int16_t*)samples + i * rp->samples_per_tick;
+        kernel(rp);
+        boundary = rp->this_tick_peak_at_boundary;
+        defined = rp->this_tick_has_well_defined_peak;
+        peak = rp->this_tick_peak;
+        early = rp->this_tick_has_early_peak;
+        late = rp->this_tick_has_late_peak;
+
+        rp->buffer_analyze = (int16_t*)samples + i * rp->samples_per_tick;
+        regulator_bench_reference(rp, sorted);
+        if (boundary != rp->this_tick_peak_at_boundary ||
+            defined != rp->this_tick_has_well_defined_peak ||
+            (defined && (peak != rp->this_tick_peak ||
+                         early != rp->this_tick_has_early_peak ||
+                         late != rp->this_tick_has_late_peak))) {
+            differ += 1;
+        }
+    }
+    return differ;
+}
+
+/**
+ * Synthetic recordings, a tick to a window.  BENCH_CLICKS: background
+ * noise with a click a little later each tick, which is what's timed.
+ * BENCH_CLIPPED: coarse noise and clipped clicks, a run of equal
+ * loudest samples, anywhere in the window, across its ends too.
+ * BENCH_TIES: a few noise levels and, every other tick, a flat-topped
+ * click; ties everywhere, and windows with no tick at all.
+ */
+static void regulator_bench_fill(int16_t* samples, size_t spt, size_t ticks,
+                                 int kind) {
+    size_t total = spt * ticks;
+    size_t at;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < total; i += 1) {
+        samples[i] = (kind == BENCH_CLICKS) ? rand() % 600 :
+            (kind == BENCH_CLIPPED) ? rand() % 4 * 150 : rand() % 3 * 200;
+    }
+    for (i = 0; i < ticks; i += 1) {
+        if (kind == BENCH_CLICKS) {
+            at = i * spt + (spt / 3 + i) % spt;
+            for (j = 0; j < 40 && at + j < total; j += 1) {
+                samples[at + j] = 20000 - j * 400;
+            }
+        } else if (kind == BENCH_CLIPPED) {
+            at = i * spt + i * 7919 % spt;
+            for (j = 0; j < 60 && at + j < total; j += 1) {
+                samples[at + j] = (j < 30) ? INT16_MAX : 30000 - j * 400;
+            }
+        } else if (i % 2) {
+            at = i * spt + i * 7919 % spt;
+            for (j = 0; j < 40 && at + j < total; j += 1) {
+                samples[at + j] = 10000;
+            }
+        }
+    }
+}
+
+/**
+ * "regulator bench": time each specialized kernel against the
+ * generic one on the same synthetic ticks, and check both against
+ * the sort they replaced, on those and on ones full of ties.
+ */
+void regulator_bench_run(struct regulator_t* rp) {
+    const regulator_kernel_entry_t* kp;
+    const size_t ticks = BENCH_TICKS;
+    regulator_t r = { .progname = rp->progname };
+    regulator_sample_t* sorted;
+    size_t generic_checksum;
+    size_t checksum;
+    size_t differ;
+    double generic_ns;
+    double ns;
+    int kind;
+
+    srand(1);
+    for (kp = regulator_kernels; kp->kernel; kp += 1) {
+        r.frames_per_second = kp->frames_per_second;
+        r.ticks_per_hour = kp->ticks_per_hour;
+        r.samples_per_tick = 3600 * kp->frames_per_second / kp->ticks_per_hour;
+
+        int16_t* samples =
+            (int16_t*)malloc(sizeof(int16_t) * r.samples_per_tick * ticks);
+        r.sample_sort_buffer =
+            (regulator_sample_t*)malloc(sizeof(regulator_sample_t) *
+                                        PEAK_SAMPLES);
+        sorted = (regulator_sample_t*)
+            malloc(sizeof(regulator_sample_t) * r.samples_per_tick);
+        if (!samples || !r.sample_sort_buffer || !sorted) {
+            perror(rp->progname);
+            exit(1);
+        }
+
+        differ = 0;
+        for (kind = BENCH_CLIPPED; kind <= BENCH_TIES; kind += 1) {
+            regulator_bench_fill(samples, r.samples_per_tick, ticks, kind);
+            differ += regulator_bench_check(&r, regulator_kernel_generic,
+                                            samples, ticks, sorted);
+            differ += regulator_bench_check(&r, kp->kernel,
+                                            samples, ticks, sorted);
+        }
+        regulator_bench_fill(samples, r.samples_per_tick, ticks, BENCH_CLICKS);
+        differ += regulator_bench_check(&r, regulator_kernel_generic,
+                                        samples, ticks, sorted);
+        differ += regulator_bench_check(&r, kp->kernel,
+                                        samples, ticks, sorted);
+        memset(&(r.noise), 0, sizeof(regulator_noise_t));
+
+        generic_ns = regulator_bench_time(&r, regulator_kernel_generic,
+                                          samples, ticks, &generic_checksum);
+        ns = regulator_bench_time(&r, kp->kernel,
+                                  samples, ticks, &checksum);
+        printf("%5d/sec %5d/hour: generic %8.1f ns/tick, "
+               "specialized %8.1f ns/tick (%.2fx)%s\n",
+               (int)kp->frames_per_second, (int)kp->ticks_per_hour,
+               generic_ns, ns, generic_ns / ns,
+               (checksum == generic_checksum) ? "" : " MISMATCH");
+        if (differ) {
+            printf("%5d/sec %5d/hour: %d ticks differ from the sort\n",
+                   (int)kp->frames_per_second, (int)kp->ticks_per_hour,
+                   (int)differ);
+        }
+
+        free(sorted);
+        free(r.sample_sort_buffer);
+        free(samples);
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef REGULATOR_BENCH_H
+#define REGULATOR_BENCH_H
+
+#include <unistd.h>
+
+#include "regulator_types.h"
+
+#define BENCH_TICKS  200
+#define BENCH_PASSES 5
+
+/* synthetic ticks; see regulator_bench_fill */
+#define BENCH_CLICKS  0
+#define BENCH_CLIPPED 1
+#define BENCH_TIES    2
+
+void regulator_bench_run(struct regulator_t* rp);
+
+#endif  /* REGULATOR_BENCH_H */
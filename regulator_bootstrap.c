@@ -0,0 +1,243 @@
+/**
+ * regulator_bootstrap.c --- confidence intervals for the drift
+ *
+ * Copyright (C) 2019 Darren Embry.  GPL2.
+ */
+
+#define REGULATOR_BOOTSTRAP_C
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "regulator.h"
+#include "regulator_bootstrap.h"
+#include "regulator_fit.h"
+
+/* xorshift64*; one per worker, so no locking and no rand() */
+static inline uint64_t regulator_bootstrap_random(uint64_t* state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+
+/* between each point and the one half the data later */
+static size_t regulator_bootstrap_slopes(const tick_peak_t* data,
+                                         size_t count, float* slopes) {
+    size_t half = count / 2;
+    size_t nslopes = 0;
+    size_t i;
+    for (i = 0; i + half < count; i += 1) {
+        if (data[i + half].index == data[i].index) {
+            continue;
+        }
+        slopes[nslopes] = (0.0f + data[i + half].peak - data[i].peak) /
+            (0.0f + data[i + half].index - data[i].index);
+        nslopes += 1;
+    }
+    return nslopes;
+}
+
+/**
+ * The fit each resample gets instead of kt_best_fit: the median of
+ * regulator_bootstrap_slopes.  Still robust against outliers, but
+ * O(n) rather than O(n^2).  data must be in tick order.
+ *
+ * A resample's median nearly always lands between the full data's
+ * BOOTSTRAP_WINDOW percentiles either side of its own, so one
+ * branch-free pass counts what's below and keeps what's between, and
+ * only that much is left to select from.
+ */
+static float regulator_bootstrap_fit(regulator_bootstrap_worker_t* wp,
+                                     size_t count) {
+    size_t nslopes = regulator_bootstrap_slopes(wp->resample, count,
+                                                wp->slopes);
+    size_t k = nslopes / 2;
+    int even = (nslopes % 2 == 0);
+    size_t below = 0;
+    size_t between = 0;
+    size_t i;
+    float slope;
+
+    if (!nslopes) {
+        return 0;
+    }
+    for (i = 0; i < nslopes; i += 1) {
+        slope = wp->slopes[i];
+        wp->between[between] = slope;
+        between += (slope >= wp->low && slope <= wp->high);
+        below += (slope < wp->low);
+    }
+    if (k - even >= below && k < below + between) {
+        return float_middle(wp->between, between, k - below, even);
+    }
+    return float_middle(wp->slopes, nslopes, k, even);
+}
+
+/**
+ * P(X <= k) for X ~ Poisson(1), k = 0 .. BOOTSTRAP_MAX_WEIGHT - 1, as
+ * fractions of 2^32.  Beyond BOOTSTRAP_MAX_WEIGHT is a one in a
+ * million chance.
+ */
+static const uint32_t regulator_bootstrap_poisson[BOOTSTRAP_MAX_WEIGHT] = {
+    1580030168U, 3160060337U, 3950075421U, 4213413783U,
+    4279248373U, 4292415291U, 4294609777U, 4294923276U
+};
+
+/**
+ * Each data point goes into a resample a Poisson(1) number of times,
+ * rather than drawing n with replacement.  For any n this is worth
+ * bootstrapping it makes no difference to the interval, and the
+ * resample comes out already in tick order, with no counting pass.
+ */
+static void* regulator_bootstrap_thread(void* arg) {
+    regulator_bootstrap_worker_t* wp = (regulator_bootstrap_worker_t*)arg;
+    uint64_t r = 0;
+    uint32_t u;
+    size_t weight;
+    size_t b;
+    size_t i;
+    size_t j;
+    size_t n;
+
+    for (b = wp->first; b < wp->last; b += 1) {
+        n = 0;
+        for (i = 0; i < wp->count; i += 1) {
+            /* two uniforms per call */
+            if (i % 2 == 0) {
+                r = regulator_bootstrap_random(&(wp->rng));
+                u = (uint32_t)r;
+            } else {
+                u = (uint32_t)(r >> 32);
+            }
+            weight = 0;
+            for (j = 0; j < BOOTSTRAP_MAX_WEIGHT; j += 1) {
+                weight += (u >= regulator_bootstrap_poisson[j]);
+            }
+            /* nearly always under BOOTSTRAP_UNROLL, so copy that
+               many and let n decide how many stay */
+            for (j = 0; j < BOOTSTRAP_UNROLL; j += 1) {
+                wp->resample[n + j] = wp->data[i];
+            }
+            for (; j < weight; j += 1) {
+                wp->resample[n + j] = wp->data[i];
+            }
+            n += weight;
+        }
+        wp->fits[b] = regulator_bootstrap_fit(wp, n);
+    }
+    return NULL;
+}
+
+/**
+ * Percentile bootstrap over the last ticks data points (all of them
+ * if 0), BOOTSTRAP_RESAMPLES resamples split over a few threads.  The
+ * interval is for drift, as regulator_result figured it: the spread
+ * of the resamples' fits around their own median, moved over onto
+ * drift, which keeps the fast fit's bias out of it.  Returns 0 if
+ * there aren't enough data points.
+ */
+int regulator_bootstrap(struct regulator_t* rp, size_t ticks, float drift,
+                        float* lowp, float* highp, double* msp) {
+    regulator_bootstrap_worker_t workers[BOOTSTRAP_MAX_THREADS];
+    struct timespec start;
+    struct timespec end;
+    const tick_peak_t* data;
+    float* fits;
+    float median;
+    float* slopes;
+    size_t nslopes;
+    float low = 0;
+    float high = 0;
+    double scale;
+    double tail;
+    long cpus;
+    size_t threads;
+    size_t i;
+
+    if (!ticks || ticks > rp->tick_peak_count) {
+        ticks = rp->tick_peak_count;
+    }
+    if (ticks < BOOTSTRAP_MIN_POINTS) {
+        return 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    data = rp->tick_peak_data + rp->tick_peak_count - ticks;
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = (cpus < 1) ? 1 :
+        (cpus > BOOTSTRAP_MAX_THREADS) ? BOOTSTRAP_MAX_THREADS : (size_t)cpus;
+
+    fits = (float*)malloc(sizeof(float) * BOOTSTRAP_RESAMPLES);
+    slopes = (float*)malloc(sizeof(float) * ticks);
+    if (!fits || !slopes) {
+        perror(rp->progname);
+        exit(1);
+    }
+    if ((nslopes = regulator_bootstrap_slopes(data, ticks, slopes))) {
+        low = float_select(
+            slopes, nslopes, nslopes * (50 - BOOTSTRAP_WINDOW) / 100);
+        high = float_select(
+            slopes, nslopes, nslopes * (50 + BOOTSTRAP_WINDOW) / 100);
+    }
+    free(slopes);
+    for (i = 0; i < threads; i += 1) {
+        regulator_bootstrap_worker_t* wp = workers + i;
+        wp->data     = data;
+        wp->count    = ticks;
+        wp->first    = BOOTSTRAP_RESAMPLES * i / threads;
+        wp->last     = BOOTSTRAP_RESAMPLES * (i + 1) / threads;
+        wp->rng      = 0x9e3779b97f4a7c15ULL * (i + 1);
+        wp->fits     = fits;
+        wp->resample = (tick_peak_t*)
+            malloc(sizeof(tick_peak_t) *
+                   (ticks * BOOTSTRAP_MAX_WEIGHT + BOOTSTRAP_UNROLL));
+        wp->slopes   = (float*)
+            malloc(sizeof(float) * ticks * BOOTSTRAP_MAX_WEIGHT);
+        wp->between  = (float*)
+            malloc(sizeof(float) * ticks * BOOTSTRAP_MAX_WEIGHT);
+        wp->low      = low;
+        wp->high     = high;
+        if (!wp->resample || !wp->slopes || !wp->between) {
+            perror(rp->progname);
+            exit(1);
+        }
+        /* the first share is done on this thread */
+        if (i && pthread_create(&(wp->thread), NULL,
+                                regulator_bootstrap_thread, wp)) {
+            perror(rp->progname);
+            exit(1);
+        }
+    }
+    regulator_bootstrap_thread(workers);
+    for (i = 0; i < threads; i += 1) {
+        if (i) {
+            pthread_join(workers[i].thread, NULL);
+        }
+        free(workers[i].resample);
+        free(workers[i].slopes);
+        free(workers[i].between);
+    }
+
+    /* in seconds per day, -/+ slow/fast, as in regulator_result */
+    scale = -1.0 / rp->frames_per_second * rp->ticks_per_hour * 24;
+    for (i = 0; i < BOOTSTRAP_RESAMPLES; i += 1) {
+        fits[i] *= scale;
+    }
+    qsort(fits, BOOTSTRAP_RESAMPLES, sizeof(float),
+          (qsort_function)float_sort);
+    median = fits[BOOTSTRAP_RESAMPLES / 2];
+    tail = (100 - rp->confidence) / 200;
+    *lowp  = drift - median +
+        fits[(size_t)(tail * (BOOTSTRAP_RESAMPLES - 1))];
+    *highp = drift - median +
+        fits[(size_t)((1 - tail) * (BOOTSTRAP_RESAMPLES - 1) + 0.5)];
+
+    free(fits);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    *msp = (end.tv_sec - start.tv_sec) * 1e3 +
+        (end.tv_nsec - start.tv_nsec) / 1e6;
+    return 1;
+}
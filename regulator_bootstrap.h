@@ -0,0 +1,36 @@
+#ifndef REGULATOR_BOOTSTRAP_H
+#define REGULATOR_BOOTSTRAP_H
+
+#include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "regulator_types.h"
+
+#define BOOTSTRAP_RESAMPLES   1000
+#define BOOTSTRAP_MAX_THREADS 8
+#define BOOTSTRAP_MIN_POINTS  10
+#define BOOTSTRAP_UNROLL      4
+#define BOOTSTRAP_MAX_WEIGHT  8
+#define BOOTSTRAP_WINDOW      5  /* percent */
+
+/* one worker of regulator_bootstrap; everything it touches is its own */
+typedef struct regulator_bootstrap_worker_t {
+    pthread_t thread;
+    const tick_peak_t* data;
+    size_t   count;
+    size_t   first;             /* resamples [first, last) */
+    size_t   last;
+    uint64_t rng;
+    tick_peak_t* resample;
+    float* slopes;
+    float* between;
+    float  low;                 /* see regulator_bootstrap_fit */
+    float  high;
+    float* fits;                /* shared, but only [first, last) */
+} regulator_bootstrap_worker_t;
+
+int regulator_bootstrap(struct regulator_t* rp, size_t ticks, float drift,
+                        float* lowp, float* highp, double* msp);
+
+#endif  /* REGULATOR_BOOTSTRAP_H */
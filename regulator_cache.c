@@ -0,0 +1,422 @@
+/**
+ * regulator_cache.c --- decoded, rectified sound files kept on disk
+ *
+ * Copyright (C) 2019 Darren Embry.  GPL2.
+ */
+
+#define REGULATOR_CACHE_C
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "regulator.h"
+#include "regulator_sndfile.h"
+#include "regulator_cache.h"
+
+#define CACHE_SUFFIX      ".rgec"
+#define CACHE_TEMP_SUFFIX ".tmp"  /* after the entry's name and a pid */
+
+static uint64_t regulator_cache_rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+/**
+ * 64-bit hash of the file's bytes, eight at a time.  Not
+ * cryptographic, only meant to tell recordings apart.
+ */
+static uint64_t regulator_cache_hash(const unsigned char* data, size_t size) {
+    const uint64_t m1 = 0x87c37b91114253d5ULL;
+    const uint64_t m2 = 0x4cf5ad432745937fULL;
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ size;
+    uint64_t k;
+    size_t i;
+
+    for (i = 0; i + 8 <= size; i += 8) {
+        memcpy(&k, data + i, 8);
+        k *= m1;
+        k = regulator_cache_rotl(k, 31);
+        k *= m2;
+        h ^= k;
+        h = regulator_cache_rotl(h, 27) * 5 + 0x52dce729;
+    }
+    k = 0;
+    memcpy(&k, data + i, size - i);
+    h ^= regulator_cache_rotl(k * m1, 31) * m2;
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/* the recording's contents plus everything that changes the decode */
+static int regulator_cache_key(struct regulator_t* rp, uint64_t* keyp) {
+    struct stat st;
+    void* map;
+    int fd;
+
+    if ((fd = open(rp->filename, O_RDONLY)) < 0) {
+        return 0;
+    }
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode) || !st.st_size) {
+        close(fd);
+        return 0;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return 0;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    *keyp = regulator_cache_hash((const unsigned char*)map, st.st_size);
+    munmap(map, st.st_size);
+
+    *keyp ^= (uint64_t)CACHE_VERSION << 56;
+    *keyp ^= (uint64_t)rp->implementation.sndfile.sfinfo.channels << 48;
+    /* filtered samples are cached under their own key */
+    *keyp ^= regulator_cache_rotl((uint64_t)(rp->filter.highpass * 1000), 13);
+    *keyp ^= regulator_cache_rotl((uint64_t)(rp->filter.lowpass * 1000), 37);
+    return 1;
+}
+
+static int regulator_cache_mkdir(const char* dir) {
+    char* path = strdup(dir);
+    char* p;
+    if (!path) {
+        return -1;
+    }
+    for (p = path + 1; *p; p += 1) {
+        if (*p == '/') {
+            *p = '\0';
+            mkdir(path, 0777);
+            *p = '/';
+        }
+    }
+    int result = (mkdir(path, 0777) && errno != EEXIST) ? -1 : 0;
+    free(path);
+    return result;
+}
+
+static int regulator_cache_map(struct regulator_t* rp, const char* path,
+                               uint64_t key) {
+    regulator_sndfile_t *ip = &(rp->implementation.sndfile);
+    const regulator_cache_header_t* header;
+    struct stat st;
+    void* map;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return 0;
+    }
+    if (fstat(fd, &st) ||
+        (size_t)st.st_size < sizeof(regulator_cache_header_t)) {
+        close(fd);
+        return 0;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return 0;
+    }
+    header = (const regulator_cache_header_t*)map;
+    if (memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) ||
+        header->version != CACHE_VERSION ||
+        header->byte_order != CACHE_BYTE_ORDER ||
+        header->key != key ||
+        header->frames_per_second != (uint64_t)ip->sfinfo.samplerate ||
+        header->header_size + header->frames * sizeof(int16_t) >
+        (size_t)st.st_size) {
+        munmap(map, st.st_size);
+        return 0;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    ip->cache_map      = map;
+    ip->cache_map_size = st.st_size;
+    ip->cache_samples  = (const int16_t*)((const char*)map + header->header_size);
+    ip->cache_frames   = header->frames;
+    ip->cache_pos      = 0;
+
+    /* a hit counts as a use, for eviction */
+    utimes(path, NULL);
+    return 1;
+}
+
+/* decode the whole file once, under a temporary name */
+static int regulator_cache_fill(struct regulator_t* rp, const char* path,
+                                uint64_t key) {
+    regulator_sndfile_t *ip = &(rp->implementation.sndfile);
+    regulator_cache_header_t header = {
+        .magic             = CACHE_MAGIC,
+        .version           = CACHE_VERSION,
+        .byte_order        = CACHE_BYTE_ORDER,
+        .header_size       = sizeof(regulator_cache_header_t),
+        .key               = key,
+        .frames_per_second = ip->sfinfo.samplerate,
+        .frames            = 0
+    };
+    size_t chunk = rp->sample_buffer_frames;
+    int16_t* buffer;
+    size_t frames;
+    char* temp;
+    FILE* fp;
+    int ok = 1;
+
+    if (!(buffer = (int16_t*)malloc(sizeof(int16_t) * chunk))) {
+        perror(rp->progname);
+        exit(1);
+    }
+    if (asprintf(&temp, "%s.%d" CACHE_TEMP_SUFFIX, path, (int)getpid()) < 0) {
+        free(buffer);
+        return 0;
+    }
+    if (!(fp = fopen(temp, "wb"))) {
+        free(buffer);
+        free(temp);
+        return 0;
+    }
+    ok = (fwrite(&header, sizeof(header), 1, fp) == 1);
+    while (ok && (frames = regulator_sndfile_read(rp, buffer, chunk)) > 0) {
+        ok = (fwrite(buffer, sizeof(int16_t), frames, fp) == frames);
+        header.frames += frames;
+    }
+    free(buffer);
+    if (ok) {
+        ok = (!fseek(fp, 0, SEEK_SET) &&
+              fwrite(&header, sizeof(header), 1, fp) == 1);
+    }
+    if (fclose(fp)) {
+        ok = 0;
+    }
+    if (ok && rename(temp, path)) {
+        ok = 0;
+    }
+    if (!ok) {
+        unlink(temp);
+    }
+    free(temp);
+    return ok;
+}
+
+/**
+ * Temporary files a fill left behind, its run killed or crashed
+ * before the rename.  Only those whose process is gone: another run
+ * may be filling one right now.
+ */
+static void regulator_cache_clean(struct regulator_t* rp) {
+    struct dirent* de;
+    const char* name_end;
+    const char* p;
+    char* end;
+    char* path;
+    long pid;
+    size_t len;
+    DIR* dir;
+
+    if (!(dir = opendir(rp->cache_dir))) {
+        return;
+    }
+    while ((de = readdir(dir))) {
+        len = strlen(de->d_name);
+        if (len <= strlen(CACHE_TEMP_SUFFIX) ||
+            strcmp(de->d_name + len - strlen(CACHE_TEMP_SUFFIX),
+                   CACHE_TEMP_SUFFIX)) {
+            continue;
+        }
+        name_end = de->d_name + len - strlen(CACHE_TEMP_SUFFIX);
+        p = name_end;
+        while (p > de->d_name && p[-1] != '.') {
+            p -= 1;           /* back to the pid */
+        }
+        pid = strtol(p, &end, 10);
+        if (p == de->d_name || end != name_end || pid <= 0 ||
+            !kill((pid_t)pid, 0) || errno != ESRCH) {
+            continue;
+        }
+        if (asprintf(&path, "%s/%s", rp->cache_dir, de->d_name) < 0) {
+            perror(rp->progname);
+            exit(1);
+        }
+        if (!unlink(path) && rp->debug >= 2) {
+            printf("cache: removed stale %s\n", path);
+        }
+        free(path);
+    }
+    closedir(dir);
+}
+
+typedef struct regulator_cache_entry_t {
+    char*  path;
+    time_t used;
+    off_t  size;
+} regulator_cache_entry_t;
+
+static int regulator_cache_entry_sort(const regulator_cache_entry_t* a,
+                                      const regulator_cache_entry_t* b) {
+    return (a->used < b->used) ? -1 : (a->used > b->used) ? 1 : 0;
+}
+
+/**
+ * Least recently used entries go first, until under the limit.  The
+ * entry about to be used is never evicted, even if it alone is over.
+ */
+static void regulator_cache_evict(struct regulator_t* rp, const char* keep) {
+    regulator_cache_entry_t* entries = NULL;
+    size_t count = 0;
+    size_t alloc = 0;
+    off_t total = 0;
+    struct dirent* de;
+    struct stat st;
+    size_t len;
+    size_t i;
+    DIR* dir;
+
+    if (!(dir = opendir(rp->cache_dir))) {
+        return;
+    }
+    while ((de = readdir(dir))) {
+        len = strlen(de->d_name);
+        if (len <= strlen(CACHE_SUFFIX) ||
+            strcmp(de->d_name + len - strlen(CACHE_SUFFIX), CACHE_SUFFIX)) {
+            continue;
+        }
+        if (count == alloc) {
+            alloc = alloc ? alloc * 2 : 16;
+            entries = (regulator_cache_entry_t*)
+                realloc(entries, sizeof(regulator_cache_entry_t) * alloc);
+            if (!entries) {
+                perror(rp->progname);
+                exit(1);
+            }
+        }
+        if (asprintf(&(entries[count].path), "%s/%s",
+                     rp->cache_dir, de->d_name) < 0) {
+            perror(rp->progname);
+            exit(1);
+        }
+        if (stat(entries[count].path, &st)) {
+            free(entries[count].path);
+            continue;
+        }
+        entries[count].used = st.st_mtime;
+        entries[count].size = st.st_size;
+        total += st.st_size;
+        count += 1;
+    }
+    closedir(dir);
+
+    qsort(entries, count, sizeof(regulator_cache_entry_t),
+          (qsort_function)regulator_cache_entry_sort);
+    for (i = 0; i < count; i += 1) {
+        if ((size_t)total > rp->cache_limit &&
+            strcmp(entries[i].path, keep) && !unlink(entries[i].path)) {
+            if (rp->debug >= 2) {
+                printf("cache: evicted %s\n", entries[i].path);
+            }
+            total -= entries[i].size;
+        }
+        free(entries[i].path);
+    }
+    free(entries);
+}
+
+/**
+ * Point the sndfile backend at a cached copy of rp->filename,
+ * decoding it into the cache first if need be.  Not with --sparse,
+ * which would then decode the whole file to look at a little of it:
+ * that takes a hit or nothing.  Returns 0 to fall back on reading the
+ * file as usual.
+ */
+int regulator_cache_open(struct regulator_t* rp) {
+    uint64_t key;
+    char* path;
+    int ok;
+
+    if (!rp->filename || !strcmp(rp->filename, "-")) {
+        return 0;
+    }
+    if (!rp->cache_dir) {
+        const char* base = getenv("XDG_CACHE_HOME");
+        int n = (base && *base) ?
+            asprintf(&(rp->cache_dir), "%s/regulator", base) :
+            asprintf(&(rp->cache_dir), "%s/.cache/regulator",
+                     getenv("HOME") ? getenv("HOME") : ".");
+        if (n < 0) {
+            perror(rp->progname);
+            exit(1);
+        }
+    }
+    if (!rp->cache_limit) {
+        rp->cache_limit = (size_t)CACHE_DEFAULT_LIMIT_MB * 1024 * 1024;
+    }
+    if (regulator_cache_mkdir(rp->cache_dir)) {
+        fprintf(stderr, "%s: can't create cache directory %s: %s\n",
+                rp->progname, rp->cache_dir, strerror(errno));
+        return 0;
+    }
+    regulator_cache_clean(rp);
+    if (!regulator_cache_key(rp, &key)) {
+        return 0;
+    }
+    if (asprintf(&path, "%s/%016llx%s", rp->cache_dir,
+                 (unsigned long long)key, CACHE_SUFFIX) < 0) {
+        perror(rp->progname);
+        exit(1);
+    }
+
+    if ((ok = regulator_cache_map(rp, path, key))) {
+        if (rp->debug >= 2) {
+            printf("cache: hit %s\n", path);
+        }
+    } else if (rp->sparse_window) {
+        if (rp->debug >= 2) {
+            printf("cache: miss, not filled for --sparse\n");
+        }
+    } else {
+        if (rp->debug >= 2) {
+            printf("cache: miss, decoding into %s\n", path);
+        }
+        if (regulator_cache_fill(rp, path, key)) {
+            regulator_cache_evict(rp, path);
+            ok = regulator_cache_map(rp, path, key);
+        }
+        if (!ok) {
+            fprintf(stderr, "%s: warning: unable to cache %s\n",
+                    rp->progname, rp->filename);
+            regulator_sndfile_rewind(rp);
+        }
+    }
+    free(path);
+    return ok;
+}
+
+void regulator_cache_close(struct regulator_t* rp) {
+    regulator_sndfile_t *ip = &(rp->implementation.sndfile);
+    if (ip->cache_map) {
+        munmap(ip->cache_map, ip->cache_map_size);
+        ip->cache_map = NULL;
+        ip->cache_samples = NULL;
+    }
+}
+
+size_t regulator_cache_read(struct regulator_t* rp,
+                            int16_t* buffer, size_t samples) {
+    regulator_sndfile_t *ip = &(rp->implementation.sndfile);
+    if (samples > ip->cache_frames - ip->cache_pos) {
+        samples = ip->cache_frames - ip->cache_pos;
+    }
+    memcpy(buffer, ip->cache_samples + ip->cache_pos,
+           sizeof(int16_t) * samples);
+    ip->cache_pos += samples;
+    return samples;
+}
@@ -0,0 +1,16 @@
+#ifndef REGULATOR_CACHE_H
+#define REGULATOR_CACHE_H
+
+#include <unistd.h>
+#include <stdint.h>
+
+#include "regulator_types.h"
+
+#define CACHE_DEFAULT_LIMIT_MB 1024
+
+int regulator_cache_open(struct regulator_t* rp);
+void regulator_cache_close(struct regulator_t* rp);
+size_t regulator_cache_read(struct regulator_t* rp,
+                            int16_t* ptr, size_t samples);
+
+#endif  /* REGULATOR_CACHE_H */
@@ -0,0 +1,492 @@
+/**
+ * regulator_daemon.c --- --daemon: run on and on, with the results so
+ * far served over a Unix domain socket
+ *
+ * Copyright (C) 2019 Darren Embry.  GPL2.
+ */
+
+#define REGULATOR_DAEMON_C
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "regulator.h"
+#include "regulator_drift.h"
+#include "regulator_daemon.h"
+
+/* epoll data for the two descriptors that aren't clients */
+#define DAEMON_LISTEN DAEMON_MAX_CLIENTS
+#define DAEMON_WAKE   (DAEMON_MAX_CLIENTS + 1)
+
+static void regulator_daemon_drop(regulator_daemon_t* dp,
+                                  regulator_daemon_client_t* cp) {
+    epoll_ctl(dp->epoll_fd, EPOLL_CTL_DEL, cp->fd, NULL);
+    close(cp->fd);
+    free(cp->out);
+    cp->fd = -1;
+    cp->out = NULL;
+}
+
+/* the server thread's copy of the snapshot, consistent */
+static void regulator_daemon_copy(regulator_daemon_t* dp) {
+    unsigned int seq;
+    do {
+        while ((seq = __atomic_load_n(&(dp->seq), __ATOMIC_ACQUIRE)) & 1) {
+            sched_yield();
+        }
+        memcpy(&(dp->copy), &(dp->snapshot), sizeof(dp->copy));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (seq != __atomic_load_n(&(dp->seq), __ATOMIC_RELAXED));
+}
+
+/* queued for the client; -1 if it hasn't read enough of what's there */
+static int regulator_daemon_printf(regulator_daemon_client_t* cp,
+                                   const char* format, ...) {
+    size_t room;
+    va_list ap;
+    int n;
+
+    if (cp->out_start) {
+        memmove(cp->out, cp->out + cp->out_start,
+                cp->out_end - cp->out_start);
+        cp->out_end -= cp->out_start;
+        cp->out_start = 0;
+    }
+    room = DAEMON_OUTPUT - cp->out_end;
+    va_start(ap, format);
+    n = vsnprintf(cp->out + cp->out_end, room, format, ap);
+    va_end(ap);
+    if (n < 0 || (size_t)n >= room) {
+        return -1;
+    }
+    cp->out_end += n;
+    return 0;
+}
+
+/**
+ * "status": counts, capture gaps and each window's rate, as one line
+ * of JSON.  drift is the longest window's, in seconds per day, + for
+ * fast; lost is in seconds.
+ */
+static int regulator_daemon_status(regulator_daemon_t* dp,
+                                   regulator_daemon_client_t* cp) {
+    const regulator_daemon_snapshot_t* sp = &(dp->copy);
+    const regulator_daemon_window_t* wp;
+    const regulator_daemon_window_t* longest = NULL;
+    float drift = 0;
+    size_t i;
+    int err = 0;
+
+    /* of those with points yet */
+    for (i = 0; i < sp->window_count; i += 1) {
+        wp = sp->windows + i;
+        if (wp->points && (!longest || wp->seconds > longest->seconds)) {
+            longest = wp;
+        }
+    }
+    if (longest) {
+        drift = longest->drift;
+    }
+    err |= regulator_daemon_printf(
+        cp, "{\"seconds\":%.1f,\"ticks\":%zu,\"good\":%zu,\"quiet\":%zu,"
+        "\"boundary\":%zu,\"ill_defined\":%zu,\"gaps\":%zu,\"lost\":%.3f,"
+        "\"drift\":%.2f,\"windows\":[",
+        (double)sp->tick_count * 3600 / sp->ticks_per_hour, sp->tick_count,
+        sp->good_tick_count, sp->quiet_tick_count, sp->boundary_peak_count,
+        sp->ill_defined_tick_count, sp->gap_count, sp->gap_seconds,
+        (double)drift);
+    for (i = 0; i < sp->window_count; i += 1) {
+        wp = sp->windows + i;
+        err |= regulator_daemon_printf(
+            cp, "%s{\"seconds\":%zu,\"drift\":%.2f,\"points\":%zu}",
+            i ? "," : "", wp->seconds, (double)wp->drift, wp->points);
+    }
+    err |= regulator_daemon_printf(cp, "]}\n");
+    return err;
+}
+
+/* "history": each window's rate every DRIFT_HISTORY_SECONDS, lately */
+static int regulator_daemon_history(regulator_daemon_t* dp,
+                                    regulator_daemon_client_t* cp) {
+    const regulator_daemon_snapshot_t* sp = &(dp->copy);
+    const regulator_daemon_window_t* wp;
+    const regulator_drift_point_t* hp;
+    size_t first;
+    size_t i;
+    size_t j;
+    int err = 0;
+
+    err |= regulator_daemon_printf(cp, "{\"windows\":[");
+    for (i = 0; i < sp->window_count; i += 1) {
+        wp = sp->windows + i;
+        err |= regulator_daemon_printf(cp, "%s{\"seconds\":%zu,\"history\":[",
+                                       i ? "," : "", wp->seconds);
+        first = (wp->history_count > DAEMON_HISTORY) ?
+            wp->history_count - DAEMON_HISTORY : 0;
+        for (j = first; j < wp->history_count; j += 1) {
+            hp = wp->history + j % DAEMON_HISTORY;
+            err |= regulator_daemon_printf(
+                cp, "%s[%.1f,%.2f,%zu]", (j > first) ? "," : "",
+                (double)hp->tick * 3600 / sp->ticks_per_hour,
+                (double)hp->drift, hp->points);
+        }
+        err |= regulator_daemon_printf(cp, "]}");
+    }
+    err |= regulator_daemon_printf(cp, "]}\n");
+    return err;
+}
+
+static int regulator_daemon_request(regulator_daemon_t* dp,
+                                    regulator_daemon_client_t* cp,
+                                    const char* line) {
+    regulator_daemon_copy(dp);
+    if (!*line || !strcmp(line, "status")) {
+        return regulator_daemon_status(dp, cp);
+    }
+    if (!strcmp(line, "history")) {
+        return regulator_daemon_history(dp, cp);
+    }
+    return regulator_daemon_printf(cp, "{\"error\":\"unknown request\"}\n");
+}
+
+/* as much as the socket takes now; the rest on EPOLLOUT */
+static int regulator_daemon_flush(regulator_daemon_t* dp,
+                                  regulator_daemon_client_t* cp) {
+    struct epoll_event ev = { .data.u32 = cp - dp->clients };
+    ssize_t n;
+
+    while (cp->out_start < cp->out_end) {
+        n = send(cp->fd, cp->out + cp->out_start, cp->out_end - cp->out_start,
+                 MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return -1;
+        }
+        cp->out_start += n;
+    }
+    ev.events = EPOLLIN | ((cp->out_start < cp->out_end) ? EPOLLOUT : 0);
+    return epoll_ctl(dp->epoll_fd, EPOLL_CTL_MOD, cp->fd, &ev);
+}
+
+/* one request per line */
+static int regulator_daemon_readable(regulator_daemon_t* dp,
+                                     regulator_daemon_client_t* cp) {
+    char* newline;
+    size_t length;
+    ssize_t n;
+
+    while (1) {
+        n = read(cp->fd, cp->in + cp->in_count,
+                 DAEMON_LINE - cp->in_count);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        if (n == 0) {
+            return -1;
+        }
+        cp->in_count += n;
+        while ((newline = memchr(cp->in, '\n', cp->in_count))) {
+            *newline = '\0';
+            length = newline - cp->in;
+            if (length && newline[-1] == '\r') {
+                newline[-1] = '\0';
+            }
+            if (regulator_daemon_request(dp, cp, cp->in)) {
+                return -1;
+            }
+            cp->in_count -= length + 1;
+            memmove(cp->in, newline + 1, cp->in_count);
+        }
+        if (cp->in_count == DAEMON_LINE) {
+            return -1;
+        }
+    }
+}
+
+static void regulator_daemon_accept(regulator_daemon_t* dp) {
+    struct epoll_event ev = { .events = EPOLLIN };
+    regulator_daemon_client_t* cp;
+    size_t i;
+    int fd;
+
+    while ((fd = accept4(dp->listen_fd, NULL, NULL,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        i = 0;
+        while (i < DAEMON_MAX_CLIENTS && dp->clients[i].fd >= 0) {
+            i += 1;
+        }
+        if (i == DAEMON_MAX_CLIENTS ||
+            !(dp->clients[i].out = (char*)malloc(DAEMON_OUTPUT))) {
+            close(fd);
+            continue;
+        }
+        cp = dp->clients + i;
+        cp->fd = fd;
+        cp->in_count = 0;
+        cp->out_start = 0;
+        cp->out_end = 0;
+        ev.data.u32 = i;
+        if (epoll_ctl(dp->epoll_fd, EPOLL_CTL_ADD, fd, &ev)) {
+            close(fd);
+            free(cp->out);
+            cp->out = NULL;
+            cp->fd = -1;
+        }
+    }
+}
+
+static void* regulator_daemon_thread(void* arg) {
+    regulator_daemon_t* dp = (regulator_daemon_t*)arg;
+    struct epoll_event events[16];
+    regulator_daemon_client_t* cp;
+    int n;
+    int i;
+
+    while (1) {
+        if ((n = epoll_wait(dp->epoll_fd, events, 16, -1)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (i = 0; i < n; i += 1) {
+            if (events[i].data.u32 == DAEMON_WAKE) {
+                return NULL;
+            }
+            if (events[i].data.u32 == DAEMON_LISTEN) {
+                regulator_daemon_accept(dp);
+                continue;
+            }
+            cp = dp->clients + events[i].data.u32;
+            if (cp->fd < 0) {
+                continue;
+            }
+            if ((events[i].events & (EPOLLERR | EPOLLHUP) &&
+                 !(events[i].events & EPOLLIN)) ||
+                ((events[i].events & EPOLLIN) &&
+                 regulator_daemon_readable(dp, cp)) ||
+                regulator_daemon_flush(dp, cp)) {
+                regulator_daemon_drop(dp, cp);
+            }
+        }
+    }
+    return NULL;
+}
+
+static void regulator_daemon_fail(struct regulator_t* rp, const char* what) {
+    fprintf(stderr, "%s: %s: %s: %s\n",
+            rp->progname, rp->socket_path, what, strerror(errno));
+    exit(1);
+}
+
+/**
+ * --socket, before regulator_drift_open.  The rate comes from the
+ * drift windows, 60 and 600 seconds unless there are others, which
+ * keep up as they go; a fit of all the data every tick would not.
+ */
+void regulator_daemon_open(struct regulator_t* rp) {
+    struct epoll_event ev = { .events = EPOLLIN };
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    regulator_daemon_t* dp;
+    struct stat st;
+    size_t i;
+
+    if (rp->daemon && rp->precision > 0) {
+        fprintf(stderr, "%s: --precision stops the run; not with --daemon\n",
+                rp->progname);
+        exit(1);
+    }
+    if (!rp->drift_window_count) {
+        regulator_drift_add_window(rp, DRIFT_DEFAULT_WINDOW_1);
+        regulator_drift_add_window(rp, DRIFT_DEFAULT_WINDOW_2);
+    }
+    if (rp->drift_window_count > DAEMON_MAX_WINDOWS) {
+        fprintf(stderr, "%s: at most %d --drift-window with --daemon\n",
+                rp->progname, DAEMON_MAX_WINDOWS);
+        exit(1);
+    }
+    for (i = 0; rp->daemon && i < rp->drift_window_count; i += 1) {
+        if (rp->drift_windows[i].seconds > DAEMON_MAX_WINDOW_SECONDS) {
+            fprintf(stderr, "%s: --drift-window can be at most %d seconds "
+                    "with --daemon\n", rp->progname, DAEMON_MAX_WINDOW_SECONDS);
+            exit(1);
+        }
+    }
+    if (strlen(rp->socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: %s: socket path too long\n",
+                rp->progname, rp->socket_path);
+        exit(1);
+    }
+    strcpy(addr.sun_path, rp->socket_path);
+
+    if (!(dp = (regulator_daemon_t*)calloc(1, sizeof(regulator_daemon_t)))) {
+        perror(rp->progname);
+        exit(1);
+    }
+    for (i = 0; i < DAEMON_MAX_CLIENTS; i += 1) {
+        dp->clients[i].fd = -1;
+    }
+    dp->snapshot.ticks_per_hour = rp->ticks_per_hour;
+    dp->snapshot.window_count = rp->drift_window_count;
+    for (i = 0; i < rp->drift_window_count; i += 1) {
+        dp->snapshot.windows[i].seconds = rp->drift_windows[i].seconds;
+    }
+
+    /* left behind by a run that was killed */
+    if (!lstat(rp->socket_path, &st) && S_ISSOCK(st.st_mode)) {
+        unlink(rp->socket_path);
+    }
+    if ((dp->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK |
+                                SOCK_CLOEXEC, 0)) < 0) {
+        regulator_daemon_fail(rp, "socket");
+    }
+    if (bind(dp->listen_fd, (struct sockaddr*)&addr, sizeof(addr))) {
+        regulator_daemon_fail(rp, "bind");
+    }
+    dp->path = rp->socket_path;
+    if (listen(dp->listen_fd, DAEMON_MAX_CLIENTS)) {
+        regulator_daemon_fail(rp, "listen");
+    }
+    if ((dp->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0 ||
+        (dp->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+        perror(rp->progname);
+        exit(1);
+    }
+    ev.data.u32 = DAEMON_LISTEN;
+    if (epoll_ctl(dp->epoll_fd, EPOLL_CTL_ADD, dp->listen_fd, &ev)) {
+        perror(rp->progname);
+        exit(1);
+    }
+    ev.data.u32 = DAEMON_WAKE;
+    if (epoll_ctl(dp->epoll_fd, EPOLL_CTL_ADD, dp->wake_fd, &ev)) {
+        perror(rp->progname);
+        exit(1);
+    }
+    if ((errno = pthread_create(&(dp->thread), NULL,
+                                regulator_daemon_thread, dp))) {
+        perror(rp->progname);
+        exit(1);
+    }
+    rp->server = dp;
+    if (rp->debug >= 1) {
+        printf("serving results on %s\n", rp->socket_path);
+    }
+}
+
+/**
+ * After each tick, from regulator_analyze_tick.  Writes go between
+ * two increments of seq, so a reader that sees it odd or changed
+ * copies again.  New --drift-history points go into each window's
+ * ring; a shorter history than already seen means it was reset.
+ */
+void regulator_daemon_publish(struct regulator_t* rp) {
+    regulator_daemon_t* dp = rp->server;
+    regulator_daemon_snapshot_t* sp = &(dp->snapshot);
+    regulator_daemon_window_t* sw;
+    regulator_drift_window_t* wp;
+    unsigned int seq = dp->seq;
+    size_t i;
+
+    __atomic_store_n(&(dp->seq), seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    sp->tick_count             = rp->tick_count + 1;
+    sp->good_tick_count        = rp->good_tick_count;
+    sp->quiet_tick_count       = rp->quiet_tick_count;
+    sp->boundary_peak_count    = rp->boundary_peak_count;
+    sp->ill_defined_tick_count = rp->ill_defined_tick_count;
+    sp->gap_count              = rp->gaps.count;
+    sp->gap_seconds            = (double)rp->gaps.lost / rp->frames_per_second;
+    for (i = 0; i < sp->window_count; i += 1) {
+        wp = rp->drift_windows + i;
+        sw = sp->windows + i;
+        sw->drift  = regulator_drift_result(wp);
+        sw->points = wp->slopes ? rp->tick_peak_count - wp->first : 0;
+        if (dp->history_seen[i] > wp->history_count) {
+            dp->history_seen[i] = 0;
+            sw->history_count = 0;
+        }
+        for (; dp->history_seen[i] < wp->history_count;
+             dp->history_seen[i] += 1) {
+            sw->history[sw->history_count % DAEMON_HISTORY] =
+                *regulator_drift_history(wp, dp->history_seen[i]);
+            sw->history_count += 1;
+        }
+    }
+
+    __atomic_store_n(&(dp->seq), seq + 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * tick_peak_data is full: drop the data points every window has
+ * passed.  No window is over DAEMON_MAX_WINDOW_SECONDS, so that's
+ * at least half of them.  Slopes are counted by data point, so only
+ * the windows' first points need renumbering.  --drift-history
+ * points are in a ring of their own, and stay.
+ */
+void regulator_daemon_rollover(struct regulator_t* rp) {
+    size_t drop = rp->tick_peak_count;
+    size_t i;
+
+    for (i = 0; i < rp->drift_window_count; i += 1) {
+        if (rp->drift_windows[i].first < drop) {
+            drop = rp->drift_windows[i].first;
+        }
+    }
+    if (!drop) {
+        fprintf(stderr, "%s: UNEXPECTED ERROR 6\n", rp->progname);
+        exit(1);
+    }
+    memmove(rp->tick_peak_data, rp->tick_peak_data + drop,
+            sizeof(tick_peak_t) * (rp->tick_peak_count - drop));
+    rp->tick_peak_count -= drop;
+    for (i = 0; i < rp->drift_window_count; i += 1) {
+        rp->drift_windows[i].first -= drop;
+    }
+    if (rp->debug >= 2) {
+        printf("dropped the oldest %d data points\n", (int)drop);
+    }
+}
+
+void regulator_daemon_close(struct regulator_t* rp) {
+    regulator_daemon_t* dp = rp->server;
+    uint64_t one = 1;
+    size_t i;
+
+    if (!dp) {
+        return;
+    }
+    if (write(dp->wake_fd, &one, sizeof(one)) != sizeof(one)) {
+        perror(rp->progname);
+    }
+    pthread_join(dp->thread, NULL);
+    for (i = 0; i < DAEMON_MAX_CLIENTS; i += 1) {
+        if (dp->clients[i].fd >= 0) {
+            regulator_daemon_drop(dp, dp->clients + i);
+        }
+    }
+    close(dp->wake_fd);
+    close(dp->epoll_fd);
+    close(dp->listen_fd);
+    unlink(dp->path);
+    free(dp);
+    rp->server = NULL;
+}
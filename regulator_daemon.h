@@ -0,0 +1,73 @@
+#ifndef REGULATOR_DAEMON_H
+#define REGULATOR_DAEMON_H
+
+#include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "regulator_types.h"
+
+#define DAEMON_MAX_CLIENTS        64
+#define DAEMON_MAX_WINDOWS        8
+#define DAEMON_MAX_WINDOW_SECONDS 1800
+#define DAEMON_HISTORY            360    /* DRIFT_HISTORY_SECONDS apart */
+#define DAEMON_LINE               256    /* longest request */
+#define DAEMON_OUTPUT             262144 /* replies a client hasn't read */
+
+typedef struct regulator_daemon_window_t {
+    size_t seconds;
+    float  drift;               /* seconds per day, -/+ slow/fast */
+    size_t points;
+    size_t history_count;       /* ever; the ring has the last few */
+    regulator_drift_point_t history[DAEMON_HISTORY];
+} regulator_daemon_window_t;
+
+/* what a client sees; see regulator_daemon_publish */
+typedef struct regulator_daemon_snapshot_t {
+    size_t tick_count;
+    size_t good_tick_count;
+    size_t quiet_tick_count;
+    size_t boundary_peak_count;
+    size_t ill_defined_tick_count;
+    size_t gap_count;
+    double gap_seconds;
+    size_t ticks_per_hour;
+    size_t window_count;
+    regulator_daemon_window_t windows[DAEMON_MAX_WINDOWS];
+} regulator_daemon_snapshot_t;
+
+typedef struct regulator_daemon_client_t {
+    int    fd;                  /* -1 for a free slot */
+    char   in[DAEMON_LINE];
+    size_t in_count;
+    char*  out;
+    size_t out_start;
+    size_t out_end;
+} regulator_daemon_client_t;
+
+/**
+ * The snapshot is guarded by a sequence count, odd while the analysis
+ * thread is writing it.  The analysis thread never waits for anyone;
+ * the server thread copies the snapshot out and tries again if the
+ * count moved meanwhile.
+ */
+typedef struct regulator_daemon_t {
+    unsigned int seq;
+    regulator_daemon_snapshot_t snapshot;
+    size_t history_seen[DAEMON_MAX_WINDOWS];
+
+    char*     path;
+    int       listen_fd;
+    int       epoll_fd;
+    int       wake_fd;          /* eventfd, to stop the server thread */
+    pthread_t thread;
+    regulator_daemon_client_t clients[DAEMON_MAX_CLIENTS];
+    regulator_daemon_snapshot_t copy; /* the server thread's */
+} regulator_daemon_t;
+
+void regulator_daemon_open(struct regulator_t* rp);
+void regulator_daemon_publish(struct regulator_t* rp);
+void regulator_daemon_rollover(struct regulator_t* rp);
+void regulator_daemon_close(struct regulator_t* rp);
+
+#endif  /* REGULATOR_DAEMON_H */
@@ -0,0 +1,241 @@
+/**
+ * regulator_decode.c --- decoding compressed sound files on several
+ * threads at once
+ *
+ * Copyright (C) 2019 Darren Embry.  GPL2.
+ */
+
+#define REGULATOR_DECODE_C
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "regulator.h"
+#include "regulator_sndfile.h"
+#include "regulator_decode.h"
+
+/**
+ * How many decoding threads rp->filename is worth: by default, one
+ * per CPU for FLAC and Ogg, whose decoding is what takes the time,
+ * and none for anything else.  --decode-threads overrides that for
+ * any seekable file.  0 or 1 means read it on the analysis thread.
+ */
+size_t regulator_decode_threads(struct regulator_t* rp) {
+    regulator_sndfile_t *ip = &(rp->implementation.sndfile);
+    int type = ip->sfinfo.format & SF_FORMAT_TYPEMASK;
+    size_t threads = rp->decode_threads;
+    long cpus;
+
+    if (!rp->filename || !strcmp(rp->filename, "-") ||
+        !ip->sfinfo.seekable ||
+        ip->sfinfo.frames <= DECODE_CHUNK_FRAMES) {
+        return 0;
+    }
+    if (!threads && (type == SF_FORMAT_FLAC || type == SF_FORMAT_OGG)) {
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (cpus < 1) ? 1 : (size_t)cpus;
+    }
+    return (threads > DECODE_MAX_THREADS) ? DECODE_MAX_THREADS : threads;
+}
+
+/* one chunk, from its own seek point */
+static void regulator_decode_chunk(regulator_decode_worker_t* wp,
+                                   regulator_decode_slot_t* slot,
+                                   size_t chunk) {
+    sf_count_t frames;
+    size_t done = 0;
+    size_t want;
+
+    slot->error = NULL;
+    slot->frames = 0;
+    if (sf_seek(wp->sf, (sf_count_t)chunk * DECODE_CHUNK_FRAMES,
+                SEEK_SET) < 0) {
+        slot->error = sf_strerror(wp->sf);
+        return;
+    }
+    while (done < DECODE_CHUNK_FRAMES) {
+        want = DECODE_CHUNK_FRAMES - done;
+        if (want > DECODE_READ_FRAMES) {
+            want = DECODE_READ_FRAMES;
+        }
+        if ((frames = sf_readf_int(wp->sf, wp->buffer, want)) <= 0) {
+            break;
+        }
+        regulator_sndfile_quantize(wp->buffer, wp->sfinfo.channels,
+                                   slot->samples + done, frames);
+        regulator_rectify_samples(slot->samples + done, frames);
+        done += frames;
+    }
+    slot->frames = done;
+}
+
+static void* regulator_decode_thread(void* arg) {
+    regulator_decode_worker_t* wp = (regulator_decode_worker_t*)arg;
+    regulator_decode_t* dp = wp->decode;
+    regulator_decode_slot_t* slot;
+    size_t chunk;
+
+    pthread_mutex_lock(&(dp->lock));
+    while (1) {
+        if (dp->stop || dp->next_chunk >= dp->chunks) {
+            break;
+        }
+        /* the reorder buffer is full until the analysis catches up */
+        if (dp->next_chunk >= dp->read_chunk + dp->slot_count) {
+            pthread_cond_wait(&(dp->cond), &(dp->lock));
+            continue;
+        }
+        chunk = dp->next_chunk;
+        dp->next_chunk += 1;
+        slot = dp->slots + chunk % dp->slot_count;
+        pthread_mutex_unlock(&(dp->lock));
+
+        regulator_decode_chunk(wp, slot, chunk);
+
+        pthread_mutex_lock(&(dp->lock));
+        slot->chunk = chunk;
+        slot->ready = 1;
+        pthread_cond_broadcast(&(dp->cond));
+    }
+    pthread_mutex_unlock(&(dp->lock));
+    return NULL;
+}
+
+void regulator_decode_open(struct regulator_t* rp) {
+    regulator_sndfile_t *ip = &(rp->implementation.sndfile);
+    regulator_decode_t* dp;
+    size_t i;
+
+    if (!(dp = (regulator_decode_t*)calloc(1, sizeof(regulator_decode_t)))) {
+        perror(rp->progname);
+        exit(1);
+    }
+    dp->rp = rp;
+    dp->worker_count = ip->decode_threads;
+    dp->slot_count = dp->worker_count * DECODE_SLOTS_PER_THREAD;
+    dp->chunks = (ip->sfinfo.frames + DECODE_CHUNK_FRAMES - 1) /
+        DECODE_CHUNK_FRAMES;
+    pthread_mutex_init(&(dp->lock), NULL);
+    pthread_cond_init(&(dp->cond), NULL);
+
+    dp->slots = (regulator_decode_slot_t*)
+        calloc(dp->slot_count, sizeof(regulator_decode_slot_t));
+    dp->workers = (regulator_decode_worker_t*)
+        calloc(dp->worker_count, sizeof(regulator_decode_worker_t));
+    if (!dp->slots || !dp->workers) {
+        perror(rp->progname);
+        exit(1);
+    }
+    for (i = 0; i < dp->slot_count; i += 1) {
+        dp->slots[i].samples =
+            (int16_t*)malloc(sizeof(int16_t) * DECODE_CHUNK_FRAMES);
+        if (!dp->slots[i].samples) {
+            perror(rp->progname);
+            exit(1);
+        }
+    }
+    for (i = 0; i < dp->worker_count; i += 1) {
+        regulator_decode_worker_t* wp = dp->workers + i;
+        wp->decode = dp;
+        if (!(wp->sf = sf_open(rp->filename, SFM_READ, &(wp->sfinfo)))) {
+            fprintf(stderr, "%s: unable to open %s: %s\n",
+                    rp->progname, rp->filename, sf_strerror(NULL));
+            exit(1);
+        }
+        wp->buffer = (int*)malloc(sizeof(int) * DECODE_READ_FRAMES *
+                                  wp->sfinfo.channels);
+        if (!wp->buffer) {
+            perror(rp->progname);
+            exit(1);
+        }
+    }
+    for (i = 0; i < dp->worker_count; i += 1) {
+        if (pthread_create(&(dp->workers[i].thread), NULL,
+                           regulator_decode_thread, dp->workers + i)) {
+            perror(rp->progname);
+            exit(1);
+        }
+    }
+    if (rp->debug >= 2) {
+        printf("decoding %d chunks on %d threads\n",
+               (int)dp->chunks, (int)dp->worker_count);
+    }
+    ip->decode = dp;
+}
+
+/* the chunks in order, whichever thread finished them first */
+size_t regulator_decode_read(struct regulator_t* rp,
+                             int16_t* buffer, size_t samples) {
+    regulator_decode_t* dp = rp->implementation.sndfile.decode;
+    regulator_decode_slot_t* slot;
+    size_t done = 0;
+    size_t count;
+
+    while (done < samples) {
+        pthread_mutex_lock(&(dp->lock));
+        if (dp->read_chunk >= dp->chunks) {
+            pthread_mutex_unlock(&(dp->lock));
+            break;
+        }
+        slot = dp->slots + dp->read_chunk % dp->slot_count;
+        while (!slot->ready || slot->chunk != dp->read_chunk) {
+            pthread_cond_wait(&(dp->cond), &(dp->lock));
+        }
+        pthread_mutex_unlock(&(dp->lock));
+        if (slot->error) {
+            fprintf(stderr, "%s: unable to seek in %s: %s\n",
+                    rp->progname, rp->filename, slot->error);
+            exit(1);
+        }
+
+        /* no worker touches a ready slot, so no lock for this */
+        count = slot->frames - dp->read_pos;
+        if (count > samples - done) {
+            count = samples - done;
+        }
+        memcpy(buffer + done, slot->samples + dp->read_pos,
+               sizeof(int16_t) * count);
+        done += count;
+        dp->read_pos += count;
+
+        if (dp->read_pos >= slot->frames) {
+            pthread_mutex_lock(&(dp->lock));
+            slot->ready = 0;
+            dp->read_pos = 0;
+            /* a short chunk means the file ended early */
+            dp->read_chunk = (slot->frames < DECODE_CHUNK_FRAMES) ?
+                dp->chunks : dp->read_chunk + 1;
+            pthread_cond_broadcast(&(dp->cond));
+            pthread_mutex_unlock(&(dp->lock));
+        }
+    }
+    return done;
+}
+
+void regulator_decode_close(struct regulator_t* rp) {
+    regulator_decode_t* dp = rp->implementation.sndfile.decode;
+    size_t i;
+
+    if (!dp) {
+        return;
+    }
+    pthread_mutex_lock(&(dp->lock));
+    dp->stop = 1;
+    pthread_cond_broadcast(&(dp->cond));
+    pthread_mutex_unlock(&(dp->lock));
+    for (i = 0; i < dp->worker_count; i += 1) {
+        pthread_join(dp->workers[i].thread, NULL);
+        sf_close(dp->workers[i].sf);
+        free(dp->workers[i].buffer);
+    }
+    for (i = 0; i < dp->slot_count; i += 1) {
+        free(dp->slots[i].samples);
+    }
+    pthread_cond_destroy(&(dp->cond));
+    pthread_mutex_destroy(&(dp->lock));
+    free(dp->slots);
+    free(dp->workers);
+    free(dp);
+    rp->implementation.sndfile.decode = NULL;
+}
@@ -0,0 +1,58 @@
+#ifndef REGULATOR_DECODE_H
+#define REGULATOR_DECODE_H
+
+#include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sndfile.h>
+
+#include "regulator_types.h"
+
+#define DECODE_CHUNK_FRAMES     262144 /* about 6 seconds */
+#define DECODE_READ_FRAMES      8192
+#define DECODE_MAX_THREADS      8
+#define DECODE_SLOTS_PER_THREAD 2
+
+/**
+ * Chunk number chunk, once ready, in slot chunk % slot_count.  If
+ * error is set, the worker couldn't decode it and the analysis thread
+ * says so when it gets there; workers never exit on their own.
+ */
+typedef struct regulator_decode_slot_t {
+    int16_t* samples;
+    size_t   chunk;
+    size_t   frames;
+    int      ready;
+    const char* error;          /* sf_strerror's, good till sf_close */
+} regulator_decode_slot_t;
+
+typedef struct regulator_decode_worker_t {
+    pthread_t thread;
+    struct regulator_decode_t* decode;
+    SNDFILE* sf;                /* each its own, to seek independently */
+    SF_INFO  sfinfo;
+    int*     buffer;
+} regulator_decode_worker_t;
+
+typedef struct regulator_decode_t {
+    struct regulator_t* rp;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    regulator_decode_slot_t*   slots;
+    size_t                     slot_count;
+    regulator_decode_worker_t* workers;
+    size_t                     worker_count;
+    size_t chunks;
+    size_t next_chunk;          /* next to hand to a worker */
+    size_t read_chunk;          /* next to hand to the analysis */
+    size_t read_pos;
+    int    stop;
+} regulator_decode_t;
+
+size_t regulator_decode_threads(struct regulator_t* rp);
+void regulator_decode_open(struct regulator_t* rp);
+size_t regulator_decode_read(struct regulator_t* rp,
+                             int16_t* ptr, size_t samples);
+void regulator_decode_close(struct regulator_t* rp);
+
+#endif  /* REGULATOR_DECODE_H */
@@ -0,0 +1,302 @@
+/**
+ * regulator_drift.c --- rate over sliding windows, as the run goes on
+ *
+ * Copyright (C) 2019 Darren Embry.  GPL2.
+ */
+
+#define REGULATOR_DRIFT_C
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "regulator.h"
+#include "regulator_drift.h"
+
+void regulator_drift_add_window(struct regulator_t* rp, size_t seconds) {
+    regulator_drift_window_t* wp;
+    rp->drift_windows = (regulator_drift_window_t*)
+        realloc(rp->drift_windows,
+                sizeof(regulator_drift_window_t) * (rp->drift_window_count + 1));
+    if (!rp->drift_windows) {
+        perror(rp->progname);
+        exit(1);
+    }
+    wp = rp->drift_windows + rp->drift_window_count;
+    memset(wp, 0, sizeof(regulator_drift_window_t));
+    wp->seconds = seconds;
+    rp->drift_window_count += 1;
+}
+
+static void regulator_drift_grow(struct regulator_t* rp,
+                                 regulator_drift_window_t* wp, size_t alloc) {
+    wp->history_alloc = alloc;
+    wp->history = (regulator_drift_point_t*)
+        realloc(wp->history, sizeof(regulator_drift_point_t) * alloc);
+    if (!wp->history) {
+        perror(rp->progname);
+        exit(1);
+    }
+}
+
+/**
+ * Once ticks_per_hour and frames_per_second are known.  --daemon
+ * runs on and on, so each window's --drift-history is a ring of the
+ * last DRIFT_DAEMON_HISTORY points, all of it allocated here.
+ */
+void regulator_drift_open(struct regulator_t* rp) {
+    regulator_drift_window_t* wp;
+    size_t i;
+
+    if (rp->drift_history_filename && !rp->drift_window_count) {
+        regulator_drift_add_window(rp, DRIFT_DEFAULT_WINDOW_1);
+        regulator_drift_add_window(rp, DRIFT_DEFAULT_WINDOW_2);
+    }
+    for (i = 0; i < rp->drift_window_count; i += 1) {
+        wp = rp->drift_windows + i;
+        wp->ticks = wp->seconds * rp->ticks_per_hour / 3600;
+        if (wp->ticks < 2) {
+            wp->ticks = 2;
+        }
+        /* same conversion as regulator_result, then into buckets */
+        wp->scale = -(double)rp->ticks_per_hour * 24 /
+            rp->frames_per_second * DRIFT_RESOLUTION;
+        wp->counts = (uint32_t*)calloc(DRIFT_BUCKETS, sizeof(uint32_t));
+        if (!wp->counts) {
+            perror(rp->progname);
+            exit(1);
+        }
+        if (rp->daemon) {
+            regulator_drift_grow(rp, wp, DRIFT_DAEMON_HISTORY);
+        }
+    }
+    rp->drift_next_history_tick = 0;
+}
+
+/* the first batch of ticks is being analyzed over again */
+void regulator_drift_reset(struct regulator_t* rp) {
+    regulator_drift_window_t* wp;
+    size_t i;
+    for (i = 0; i < rp->drift_window_count; i += 1) {
+        wp = rp->drift_windows + i;
+        memset(wp->counts, 0, sizeof(uint32_t) * DRIFT_BUCKETS);
+        wp->cursor = 0;
+        wp->below = 0;
+        wp->first = 0;
+        wp->slopes = 0;
+        wp->history_count = 0;
+    }
+    rp->drift_next_history_tick = 0;
+}
+
+/**
+ * Counts the slope between data points a and b in or out of the
+ * window's histogram.  The slope is figured exactly as kt_best_fit does,
+ * so that the one going out lands in the same bucket it went into.
+ * Slopes off either end of DRIFT_RANGE pile up in the end buckets,
+ * which leaves the median alone as long as it is in range.
+ */
+static void regulator_drift_count(struct regulator_t* rp,
+                                  regulator_drift_window_t* wp,
+                                  size_t a, size_t b, int delta) {
+    const tick_peak_t* data = rp->tick_peak_data;
+    float slope = (0.0f + data[b].peak - data[a].peak) /
+        (0.0f + data[b].index - data[a].index);
+    double bucket = slope * wp->scale + DRIFT_RANGE * DRIFT_RESOLUTION;
+    size_t i;
+
+    if (bucket < 0) {
+        i = 0;
+    } else if (bucket > DRIFT_BUCKETS - 1) {
+        i = DRIFT_BUCKETS - 1;
+    } else {
+        i = (size_t)lround(bucket);
+    }
+    wp->counts[i] += delta;
+    if (i < wp->cursor) {
+        wp->below += delta;
+    }
+    wp->slopes += delta;
+}
+
+/**
+ * Bucket holding the kth smallest slope, counting from 0, found by
+ * walking the cursor there from the last one; the rate changes
+ * slowly, so that is a few buckets, not a pass over all of them.
+ */
+static size_t regulator_drift_kth(regulator_drift_window_t* wp, size_t k) {
+    while (wp->below > k) {
+        wp->cursor -= 1;
+        wp->below -= wp->counts[wp->cursor];
+    }
+    while (wp->below + wp->counts[wp->cursor] <= k) {
+        wp->below += wp->counts[wp->cursor];
+        wp->cursor += 1;
+    }
+    return wp->cursor;
+}
+
+float regulator_drift_result(regulator_drift_window_t* wp) {
+    double bucket;
+    if (!wp->slopes) {
+        return 0;
+    }
+    if (wp->slopes % 2 == 0) {
+        bucket = (regulator_drift_kth(wp, wp->slopes / 2 - 1) +
+                  regulator_drift_kth(wp, wp->slopes / 2)) / 2.0;
+    } else {
+        bucket = regulator_drift_kth(wp, wp->slopes / 2);
+    }
+    return (float)(bucket / DRIFT_RESOLUTION - DRIFT_RANGE);
+}
+
+/**
+ * Room for every window's history over the next so many seconds,
+ * allocated now rather than as it fills; for --realtime.
+ */
+void regulator_drift_reserve(struct regulator_t* rp, size_t seconds) {
+    regulator_drift_window_t* wp;
+    size_t points = seconds / DRIFT_HISTORY_SECONDS + 1;
+    size_t i;
+    if (rp->daemon) {
+        return;                 /* a ring, already all there */
+    }
+    for (i = 0; i < rp->drift_window_count; i += 1) {
+        wp = rp->drift_windows + i;
+        if (wp->history_alloc < wp->history_count + points) {
+            regulator_drift_grow(rp, wp, wp->history_count + points);
+        }
+    }
+}
+
+static void regulator_drift_record(struct regulator_t* rp,
+                                   regulator_drift_window_t* wp) {
+    regulator_drift_point_t* hp;
+    if (wp->history_count == wp->history_alloc && !rp->daemon) {
+        regulator_drift_grow(rp, wp,
+                             wp->history_alloc ? wp->history_alloc * 2 : 64);
+    }
+    hp = wp->history + wp->history_count % wp->history_alloc;
+    hp->tick = rp->tick_count;
+    hp->drift = regulator_drift_result(wp);
+    hp->points = rp->tick_peak_count - wp->first;
+    wp->history_count += 1;
+}
+
+/* the jth history point ever; a ring's has to be one of the last */
+const regulator_drift_point_t*
+regulator_drift_history(const regulator_drift_window_t* wp, size_t j) {
+    return wp->history + j % wp->history_alloc;
+}
+
+/* the oldest still there */
+size_t regulator_drift_history_first(const regulator_drift_window_t* wp) {
+    return (wp->history_count > wp->history_alloc) ?
+        wp->history_count - wp->history_alloc : 0;
+}
+
+/**
+ * After regulator_analyze_tick stores a data point.  Points that fell
+ * out of each window take their slopes with them and the new point
+ * brings one slope per point still in, so a tick costs a pass over
+ * the window, not the full refit regulator_result does.
+ */
+void regulator_drift_add(struct regulator_t* rp) {
+    regulator_drift_window_t* wp;
+    size_t last = rp->tick_peak_count - 1;
+    size_t tick = rp->tick_peak_data[last].index;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < rp->drift_window_count; i += 1) {
+        wp = rp->drift_windows + i;
+        while (wp->first < last &&
+               rp->tick_peak_data[wp->first].index + wp->ticks <= tick) {
+            for (j = wp->first + 1; j < last; j += 1) {
+                regulator_drift_count(rp, wp, wp->first, j, -1);
+            }
+            wp->first += 1;
+        }
+        for (j = wp->first; j < last; j += 1) {
+            regulator_drift_count(rp, wp, j, last, 1);
+        }
+    }
+
+    if (rp->tick_count >= rp->drift_next_history_tick) {
+        for (i = 0; i < rp->drift_window_count; i += 1) {
+            if (rp->drift_windows[i].slopes) {
+                regulator_drift_record(rp, rp->drift_windows + i);
+            }
+        }
+        rp->drift_next_history_tick = rp->tick_count +
+            DRIFT_HISTORY_SECONDS * rp->ticks_per_hour / 3600;
+    }
+}
+
+void regulator_drift_show(struct regulator_t* rp) {
+    regulator_drift_window_t* wp;
+    float drift;
+    size_t i;
+    for (i = 0; i < rp->drift_window_count; i += 1) {
+        wp = rp->drift_windows + i;
+        if (!wp->slopes) {
+            continue;
+        }
+        drift = regulator_drift_result(wp);
+        printf("past %d seconds: %f seconds %s\n",
+               (int)wp->seconds,
+               (double)(drift < 0 ? -drift : drift),
+               (drift < 0 ? "slow" : "fast"));
+    }
+}
+
+/**
+ * --drift-history: one line per window every DRIFT_HISTORY_SECONDS,
+ * "<seconds into run> <window seconds> <drift> <data points>"; with
+ * --daemon, for the last DRIFT_DAEMON_HISTORY of them.
+ */
+void regulator_drift_save(struct regulator_t* rp) {
+    regulator_drift_window_t* wp;
+    const regulator_drift_point_t* hp;
+    FILE* fp;
+    size_t i;
+    size_t j;
+
+    if (!rp->drift_history_filename) {
+        return;
+    }
+    if (!(fp = fopen(rp->drift_history_filename, "w"))) {
+        fprintf(stderr, "%s: unable to write %s: %s\n",
+                rp->progname, rp->drift_history_filename, strerror(errno));
+        return;
+    }
+    fprintf(fp, "# seconds\twindow\tdrift\tpoints\n");
+    for (i = 0; i < rp->drift_window_count; i += 1) {
+        wp = rp->drift_windows + i;
+        for (j = regulator_drift_history_first(wp); j < wp->history_count;
+             j += 1) {
+            hp = regulator_drift_history(wp, j);
+            fprintf(fp, "%.1f\t%d\t%.2f\t%d\n",
+                    (double)hp->tick * 3600 / rp->ticks_per_hour,
+                    (int)wp->seconds, (double)hp->drift, (int)hp->points);
+        }
+    }
+    if (fclose(fp)) {
+        fprintf(stderr, "%s: unable to write %s: %s\n",
+                rp->progname, rp->drift_history_filename, strerror(errno));
+    }
+}
+
+void regulator_drift_close(struct regulator_t* rp) {
+    size_t i;
+    for (i = 0; i < rp->drift_window_count; i += 1) {
+        free(rp->drift_windows[i].counts);
+        free(rp->drift_windows[i].history);
+        rp->drift_windows[i].counts = NULL;
+        rp->drift_windows[i].history = NULL;
+        rp->drift_windows[i].history_count = 0;
+        rp->drift_windows[i].history_alloc = 0;
+    }
+}
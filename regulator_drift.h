@@ -0,0 +1,29 @@
+#ifndef REGULATOR_DRIFT_H
+#define REGULATOR_DRIFT_H
+
+#include <unistd.h>
+
+#include "regulator_types.h"
+
+#define DRIFT_RESOLUTION       100  /* buckets per second per day */
+#define DRIFT_RANGE            3600 /* seconds per day, either way */
+#define DRIFT_BUCKETS          (2 * DRIFT_RANGE * DRIFT_RESOLUTION + 1)
+#define DRIFT_HISTORY_SECONDS  10
+#define DRIFT_DEFAULT_WINDOW_1 60
+#define DRIFT_DEFAULT_WINDOW_2 600
+#define DRIFT_DAEMON_HISTORY   8640 /* points; a day's */
+
+void regulator_drift_add_window(struct regulator_t* rp, size_t seconds);
+void regulator_drift_open(struct regulator_t* rp);
+void regulator_drift_reset(struct regulator_t* rp);
+void regulator_drift_reserve(struct regulator_t* rp, size_t seconds);
+const regulator_drift_point_t*
+regulator_drift_history(const regulator_drift_window_t* wp, size_t j);
+size_t regulator_drift_history_first(const regulator_drift_window_t* wp);
+void regulator_drift_add(struct regulator_t* rp);
+float regulator_drift_result(regulator_drift_window_t* wp);
+void regulator_drift_show(struct regulator_t* rp);
+void regulator_drift_save(struct regulator_t* rp);
+void regulator_drift_close(struct regulator_t* rp);
+
+#endif  /* REGULATOR_DRIFT_H */
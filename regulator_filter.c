@@ -0,0 +1,134 @@
+/**
+ * regulator_filter.c --- --highpass and --lowpass, to keep rumble and
+ * hiss from outshouting the ticks
+ *
+ * Copyright (C) 2019 Darren Embry.  GPL2.
+ */
+
+#define REGULATOR_FILTER_C
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "regulator.h"
+#include "regulator_filter.h"
+
+int regulator_filter_enabled(struct regulator_t* rp) {
+    return rp->filter.highpass > 0 || rp->filter.lowpass > 0;
+}
+
+/* from the Audio EQ Cookbook */
+static void regulator_filter_section(regulator_biquad_t* bp, int highpass,
+                                     double frequency, double rate,
+                                     double q) {
+    double w0 = 2 * M_PI * frequency / rate;
+    double cosw = cos(w0);
+    double alpha = sin(w0) / (2 * q);
+    double a0 = 1 + alpha;
+    double b1 = highpass ? -(1 + cosw) : (1 - cosw);
+
+    bp->b0 = (highpass ? -b1 : b1) / 2 / a0;
+    bp->b1 = b1 / a0;
+    bp->b2 = bp->b0;
+    bp->a1 = -2 * cosw / a0;
+    bp->a2 = (1 - alpha) / a0;
+    bp->z1 = 0;
+    bp->z2 = 0;
+}
+
+/* each pass is fourth-order Butterworth, 24 dB per octave */
+void regulator_filter_design(struct regulator_t* rp) {
+    regulator_filter_t* fp = &(rp->filter);
+    double nyquist = rp->frames_per_second / 2.0;
+
+    if (fp->highpass >= nyquist || fp->lowpass >= nyquist ||
+        (fp->highpass > 0 && fp->lowpass > 0 &&
+         fp->highpass >= fp->lowpass)) {
+        fprintf(stderr, "%s: can't filter %g-%g Hz "
+                "with sample rate %d/sec\n", rp->progname,
+                fp->highpass, fp->lowpass, (int)rp->frames_per_second);
+        exit(1);
+    }
+    fp->sections = 0;
+    if (fp->highpass > 0) {
+        regulator_filter_section(fp->biquads + fp->sections++, 1,
+                                 fp->highpass, rp->frames_per_second,
+                                 FILTER_Q_1);
+        regulator_filter_section(fp->biquads + fp->sections++, 1,
+                                 fp->highpass, rp->frames_per_second,
+                                 FILTER_Q_2);
+    }
+    if (fp->lowpass > 0) {
+        regulator_filter_section(fp->biquads + fp->sections++, 0,
+                                 fp->lowpass, rp->frames_per_second,
+                                 FILTER_Q_1);
+        regulator_filter_section(fp->biquads + fp->sections++, 0,
+                                 fp->lowpass, rp->frames_per_second,
+                                 FILTER_Q_2);
+    }
+    fp->rate = rp->frames_per_second;
+    if (rp->debug >= 2) {
+        printf("filtering with %d biquad sections\n", (int)fp->sections);
+    }
+}
+
+/**
+ * One section over a whole block, its state in registers.  The
+ * recursion can't be vectorized along time; running the block
+ * section by section keeps the loop tiny and the block in L1.
+ */
+static inline __attribute__((always_inline))
+void regulator_filter_biquad(regulator_biquad_t* bp, float* x, size_t n) {
+    const float b0 = bp->b0, b1 = bp->b1, b2 = bp->b2;
+    const float a1 = bp->a1, a2 = bp->a2;
+    float z1 = bp->z1;
+    float z2 = bp->z2;
+    float in;
+    float out;
+    size_t i;
+
+    for (i = 0; i < n; i += 1) {
+        in = x[i];
+        out = b0 * in + z1;
+        z1 = b1 * in - a1 * out + z2;
+        z2 = b2 * in - a2 * out;
+        x[i] = out;
+    }
+    /* silence would otherwise decay into denormals */
+    bp->z1 = (fabsf(z1) < FILTER_DENORMAL) ? 0 : z1;
+    bp->z2 = (fabsf(z2) < FILTER_DENORMAL) ? 0 : z2;
+}
+
+/* signed samples in place, before regulator_rectify takes the sign */
+void regulator_filter_run(struct regulator_t* rp,
+                          int16_t* samples, size_t count) {
+    regulator_filter_t* fp = &(rp->filter);
+    float block[FILTER_BLOCK];
+    size_t done;
+    size_t n;
+    size_t i;
+    size_t s;
+    float y;
+
+    if (fp->rate != rp->frames_per_second) {
+        regulator_filter_design(rp);
+    }
+    for (done = 0; done < count; done += n) {
+        n = (count - done < FILTER_BLOCK) ? count - done : FILTER_BLOCK;
+
+        /* conversions both ways vectorize */
+        for (i = 0; i < n; i += 1) {
+            block[i] = samples[done + i];
+        }
+        for (s = 0; s < fp->sections; s += 1) {
+            regulator_filter_biquad(fp->biquads + s, block, n);
+        }
+        for (i = 0; i < n; i += 1) {
+            y = block[i];
+            y = (y > INT16_MAX) ? INT16_MAX : (y < -INT16_MAX) ? -INT16_MAX : y;
+            samples[done + i] = (int16_t)y;
+        }
+    }
+}
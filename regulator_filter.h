@@ -0,0 +1,19 @@
+#ifndef REGULATOR_FILTER_H
+#define REGULATOR_FILTER_H
+
+#include <unistd.h>
+#include <stdint.h>
+
+#include "regulator_types.h"
+
+#define FILTER_BLOCK     256    /* samples converted to float at once */
+#define FILTER_Q_1       0.54119610f /* fourth-order Butterworth, */
+#define FILTER_Q_2       1.30656296f /* as two second-order sections */
+#define FILTER_DENORMAL  1e-20f
+
+int regulator_filter_enabled(struct regulator_t* rp);
+void regulator_filter_design(struct regulator_t* rp);
+void regulator_filter_run(struct regulator_t* rp,
+                          int16_t* samples, size_t count);
+
+#endif  /* REGULATOR_FILTER_H */
@@ -0,0 +1,146 @@
+/**
+ * regulator_fit.c --- fitting a line to the tick peaks
+ *
+ * Copyright (C) 2019 Darren Embry.  GPL2.
+ */
+
+#define REGULATOR_FIT_C
+
+#include <stdlib.h>
+#include <errno.h>
+
+#include "regulator.h"
+#include "regulator_fit.h"
+
+/**
+ * Kendall-Theil best fit.  Mainly so outliers affect the results less.
+ * Stores the slope, in samples per tick, in *slopep.  Returns -1 with
+ * errno set if the slopes can't be allocated; no output, no exit, so
+ * libregulator can use it too.
+ */
+int kt_best_fit(const tick_peak_t* data, size_t ticks, float* slopep) {
+    if (ticks < 2) {
+        *slopep = 0;
+        return 0;
+    }
+    float* slopes = (float*)malloc(sizeof(float) * KT_SLOPES(ticks));
+    if (!slopes) {
+        errno = ENOMEM;
+        return -1;
+    }
+    kt_best_fit_into(data, ticks, slopep, slopes);
+    free(slopes);
+    return 0;
+}
+
+/**
+ * kt_best_fit, with the caller's room for KT_SLOPES(ticks) slopes;
+ * allocates nothing, for --realtime.
+ */
+void kt_best_fit_into(const tick_peak_t* data, size_t ticks, float* slopep,
+                      float* slopes) {
+    if (ticks < 2) {
+        *slopep = 0;
+        return;
+    }
+    size_t nslopes = KT_SLOPES(ticks);
+    size_t si = 0;
+    for (size_t i = 0; i < ticks - 1; i += 1) {
+        for (size_t j = i + 1; j < ticks; j += 1) {
+            slopes[si] = (0.0f + data[j].peak - data[i].peak) /
+                (0.0f + data[j].index - data[i].index);
+            si += 1;
+        }
+    }
+
+    /* median; a selection, not a sort, which may allocate */
+    *slopep = float_middle(slopes, nslopes, nslopes / 2, nslopes % 2 == 0);
+}
+
+/* least squares a point at a time, in O(1) and without allocating */
+void ls_fit_add(regulator_precision_t* pp, double x, double y) {
+    double dx = x - pp->mean_tick;
+    double dy = y - pp->mean_peak;
+
+    pp->count += 1;
+    pp->mean_tick += dx / pp->count;
+    pp->mean_peak += dy / pp->count;
+    pp->sxx += dx * (x - pp->mean_tick);
+    pp->sxy += dx * (y - pp->mean_peak);
+    pp->syy += dy * (y - pp->mean_peak);
+}
+
+/* in samples per tick, as kt_best_fit's */
+float ls_fit_slope(const regulator_precision_t* pp) {
+    if (pp->count < 2 || pp->sxx <= 0) {
+        return 0;
+    }
+    return (float)(pp->sxy / pp->sxx);
+}
+
+/**
+ * Helper function for best fit.
+ */
+int float_sort(const float* a, const float* b) {
+    return (*a < *b) ? -1 : (*a > *b) ? 1 : 0;
+}
+
+/* quickselect; afterwards values[k] is where a sort would put it */
+float float_select(float* values, size_t count, size_t k) {
+    size_t low = 0;
+    size_t high = count - 1;
+    size_t i;
+    size_t j;
+    float pivot;
+    float swap;
+
+    while (low < high) {
+        pivot = values[low + (high - low) / 2];
+        i = low;
+        j = high;
+        while (i <= j) {
+            while (values[i] < pivot) {
+                i += 1;
+            }
+            while (values[j] > pivot) {
+                j -= 1;
+            }
+            if (i <= j) {
+                swap = values[i];
+                values[i] = values[j];
+                values[j] = swap;
+                i += 1;
+                if (j == 0) {
+                    break;
+                }
+                j -= 1;
+            }
+        }
+        if (k <= j) {
+            high = j;
+        } else if (k >= i) {
+            low = i;
+        } else {
+            break;
+        }
+    }
+    return values[k];
+}
+
+/* values[k], averaged with the one below it if even */
+float float_middle(float* values, size_t count, size_t k, int even) {
+    float result = float_select(values, count, k);
+    float below;
+    size_t i;
+    if (even) {
+        /* the other middle one is the largest below k */
+        below = values[0];
+        for (i = 1; i < k; i += 1) {
+            if (values[i] > below) {
+                below = values[i];
+            }
+        }
+        result = (result + below) / 2;
+    }
+    return result;
+}
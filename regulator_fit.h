@@ -0,0 +1,22 @@
+#ifndef REGULATOR_FIT_H
+#define REGULATOR_FIT_H
+
+#include <unistd.h>
+
+#include "regulator_types.h"
+
+/* pairs of data points kt_best_fit takes the slope of */
+#define KT_SLOPES(ticks) ((ticks) * ((ticks) - 1) / 2)
+
+int kt_best_fit(const tick_peak_t* data, size_t ticks, float* slopep);
+void kt_best_fit_into(const tick_peak_t* data, size_t ticks, float* slopep,
+                      float* slopes);
+
+void ls_fit_add(regulator_precision_t* pp, double x, double y);
+float ls_fit_slope(const regulator_precision_t* pp);
+
+int float_sort(const float* a, const float* b);
+float float_select(float* values, size_t count, size_t k);
+float float_middle(float* values, size_t count, size_t k, int even);
+
+#endif  /* REGULATOR_FIT_H */
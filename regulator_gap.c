@@ -0,0 +1,96 @@
+/**
+ * regulator_gap.c --- noticing the audio a live capture lost
+ *
+ * Copyright (C) 2019 Darren Embry.  GPL2.
+ */
+
+#define REGULATOR_GAP_C
+
+#include <stdio.h>
+#include <time.h>
+
+#include "regulator.h"
+#include "regulator_gap.h"
+
+/**
+ * After each read from a backend that knows its latency: the frames
+ * read plus those still waiting to be read should keep up with the
+ * monotonic clock.  How far behind they are moves slowly, with the
+ * sound card's clock against the system's and with latency jitter,
+ * and is followed; a jump of more than GAP_THRESHOLD_MS is audio that
+ * was dropped, by an overrun in the sound server or the driver.
+ */
+void regulator_gap_check(struct regulator_t* rp, size_t frames) {
+    regulator_gap_t* gp = &(rp->gaps);
+    struct timespec now;
+    double elapsed;
+    double behind;
+    double jump;
+    size_t latency;
+    size_t lost;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    latency = rp->backend->latency(rp);
+    if (!gp->started) {
+        gp->started = 1;
+        gp->start = now;
+        gp->frames = 0;
+        gp->behind = -(double)latency;
+        return;
+    }
+    gp->frames += frames;
+    elapsed = (now.tv_sec - gp->start.tv_sec) +
+        (now.tv_nsec - gp->start.tv_nsec) / 1e9;
+    behind = elapsed * rp->frames_per_second - (double)(gp->frames + latency);
+    jump = behind - gp->behind;
+
+    if (jump <= (double)rp->frames_per_second * GAP_THRESHOLD_MS / 1000) {
+        gp->behind += jump / GAP_TRACKING;
+        return;
+    }
+    lost = (size_t)(jump + 0.5);
+    gp->behind = behind;
+    gp->pending += lost;
+    gp->count += 1;
+    gp->lost += lost;
+    if (lost > gp->longest) {
+        gp->longest = lost;
+    }
+    if (rp->debug >= 1) {
+        printf("capture gap: %d frames (%.3f seconds) lost near tick # %d\n",
+               (int)lost, (double)lost / rp->frames_per_second,
+               (int)rp->tick_count);
+    }
+}
+
+/**
+ * Between ticks, move past what was lost: the tick count on by the
+ * nearest whole number of ticks, and the rest taken as a shift of the
+ * windows, as when peaks run early or late.  The tick count then goes
+ * by the time that's passed, not by the audio that arrived.
+ */
+void regulator_gap_skip(struct regulator_t* rp) {
+    regulator_gap_t* gp = &(rp->gaps);
+    size_t ticks = (gp->pending + rp->samples_per_tick / 2) /
+        rp->samples_per_tick;
+    ssize_t rest = (ssize_t)gp->pending -
+        (ssize_t)(ticks * rp->samples_per_tick);
+
+    rp->tick_count += ticks;
+    rp->peak_offset -= rest;
+    if (rp->debug >= 2) {
+        printf("skipping %d ticks and shifting by %d for a capture gap\n",
+               (int)ticks, (int)rest);
+    }
+    gp->pending = 0;
+}
+
+void regulator_gap_show(struct regulator_t* rp) {
+    regulator_gap_t* gp = &(rp->gaps);
+    if (!gp->count) {
+        return;
+    }
+    printf("%d capture gaps, %.3f seconds lost (longest %.3f)\n",
+           (int)gp->count, (double)gp->lost / rp->frames_per_second,
+           (double)gp->longest / rp->frames_per_second);
+}
@@ -0,0 +1,15 @@
+#ifndef REGULATOR_GAP_H
+#define REGULATOR_GAP_H
+
+#include <unistd.h>
+
+#include "regulator_types.h"
+
+#define GAP_THRESHOLD_MS 20     /* smaller is latency jitter */
+#define GAP_TRACKING     16     /* reads for the usual lag to settle */
+
+void regulator_gap_check(struct regulator_t* rp, size_t frames);
+void regulator_gap_skip(struct regulator_t* rp);
+void regulator_gap_show(struct regulator_t* rp);
+
+#endif  /* REGULATOR_GAP_H */
@@ -0,0 +1,322 @@
+/**
+ * regulator_guess.c --- "regulator guess": which beat rate is it?
+ * Every candidate analyzed at once, off one read of the audio
+ *
+ * Copyright (C) 2019 Darren Embry.  GPL2.
+ */
+
+#define REGULATOR_GUESS_C
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "regulator.h"
+#include "regulator_fit.h"
+#include "regulator_guess.h"
+
+/* the usual beat rates, 4 through 10 beats per second */
+static const size_t regulator_guess_defaults[] = {
+    14400, 18000, 19800, 21600, 25200, 28800, 36000, 0
+};
+
+static void* regulator_guess_thread(void* arg) {
+    regulator_guess_rate_t* gp = (regulator_guess_rate_t*)arg;
+    regulator_guess_t* guess = gp->guess;
+    size_t slot;
+
+    pthread_mutex_lock(&(guess->lock));
+    while (!gp->done) {
+        if (gp->consumed == guess->written) {
+            if (guess->eof) {
+                break;
+            }
+            pthread_cond_wait(&(guess->cond), &(guess->lock));
+            continue;
+        }
+        slot = gp->consumed % GUESS_BLOCKS;
+        pthread_mutex_unlock(&(guess->lock));
+
+        /* a lone context, so no lock while it works */
+        gp->status = regulator_lib_feed(gp->lp, guess->blocks[slot],
+                                        guess->frames[slot], 1);
+
+        pthread_mutex_lock(&(guess->lock));
+        gp->consumed += 1;
+        if (gp->status) {
+            gp->done = 1;
+        }
+        pthread_cond_broadcast(&(guess->cond));
+    }
+    gp->done = 1;
+    pthread_cond_broadcast(&(guess->cond));
+    pthread_mutex_unlock(&(guess->lock));
+    return NULL;
+}
+
+/* can the slot the next block goes in be reused?  under the lock */
+static int regulator_guess_slot_free(regulator_guess_t* guess) {
+    size_t i;
+    for (i = 0; i < guess->rate_count; i += 1) {
+        if (!guess->rates[i].done &&
+            guess->written - guess->rates[i].consumed >= GUESS_BLOCKS) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int regulator_guess_all_done(regulator_guess_t* guess) {
+    size_t i;
+    for (i = 0; i < guess->rate_count; i += 1) {
+        if (!guess->rates[i].done) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * How far the good ticks' peaks scatter about the fitted line: the
+ * median absolute deviation, in milliseconds.  Small for the right
+ * rate; for a wrong one, whatever ticks pass are scattered through
+ * the window.
+ */
+static double regulator_guess_scatter(struct regulator_t* rp,
+                                      regulator_guess_rate_t* gp) {
+    size_t count = gp->result.good_ticks;
+    regulator_lib_peak_t* peaks;
+    float* residuals;
+    double slope;
+    float median;
+    double scatter;
+    size_t i;
+
+    if (count < 2) {
+        return 0;
+    }
+    peaks = (regulator_lib_peak_t*)malloc(sizeof(regulator_lib_peak_t) * count);
+    residuals = (float*)malloc(sizeof(float) * count);
+    if (!peaks || !residuals) {
+        perror(rp->progname);
+        exit(1);
+    }
+    count = regulator_lib_peaks(gp->lp, peaks, count);
+
+    /* back from seconds per day to samples per tick */
+    slope = -gp->result.drift * rp->frames_per_second /
+        gp->ticks_per_hour / 24;
+    for (i = 0; i < count; i += 1) {
+        residuals[i] = peaks[i].peak - slope * peaks[i].tick;
+    }
+    qsort(residuals, count, sizeof(float), (qsort_function)float_sort);
+    median = residuals[count / 2];
+    for (i = 0; i < count; i += 1) {
+        residuals[i] = (residuals[i] < median) ?
+            median - residuals[i] : residuals[i] - median;
+    }
+    qsort(residuals, count, sizeof(float), (qsort_function)float_sort);
+    scatter = residuals[count / 2] * 1000.0 / rp->frames_per_second;
+
+    free(residuals);
+    free(peaks);
+    return scatter;
+}
+
+/**
+ * The share of good ticks, discounted by the scatter: peaks spread
+ * evenly through the window, as a wrong rate's are, have a median
+ * deviation of a quarter tick and count for nothing.  On a noisy
+ * recording few ticks pass at any rate, and then it's the tight fit
+ * that tells.
+ */
+static double regulator_guess_score(regulator_guess_rate_t* gp) {
+    double tick_ms = 3600.0 * 1000 / gp->ticks_per_hour;
+    double spread = 4 * gp->scatter / tick_ms;
+    return gp->good_ratio * (spread < 1 ? 1 - spread : 0);
+}
+
+static int regulator_guess_sort(const regulator_guess_rate_t* a,
+                                const regulator_guess_rate_t* b) {
+    if (!a->status != !b->status) {
+        return a->status ? 1 : -1;
+    }
+    if (a->score != b->score) {
+        return (a->score > b->score) ? -1 : 1;
+    }
+    return (a->scatter < b->scatter) ? -1 : (a->scatter > b->scatter) ? 1 : 0;
+}
+
+static void regulator_guess_add(struct regulator_t* rp,
+                                regulator_guess_t* guess,
+                                size_t ticks_per_hour, int quiet) {
+    regulator_guess_rate_t* gp = guess->rates + guess->rate_count;
+    int status;
+
+    if (guess->rate_count == GUESS_MAX_RATES) {
+        fprintf(stderr, "%s: guess: at most %d rates\n",
+                rp->progname, GUESS_MAX_RATES);
+        exit(1);
+    }
+    if ((status = regulator_lib_new(&(gp->lp), rp->frames_per_second,
+                                    ticks_per_hour))) {
+        if (status == REGULATOR_LIB_NOMEM) {
+            perror(rp->progname);
+            exit(1);
+        }
+        if (!quiet || rp->debug >= 1) {
+            fprintf(stderr, "%s: guess: can't process %d ticks per hour "
+                    "with sample rate %d/sec\n", rp->progname,
+                    (int)ticks_per_hour, (int)rp->frames_per_second);
+        }
+        return;
+    }
+    gp->guess = guess;
+    gp->ticks_per_hour = ticks_per_hour;
+    guess->rate_count += 1;
+}
+
+/**
+ * "regulator guess [<ticks-per-hour> ...]": analyze the first
+ * GUESS_SECONDS at each candidate rate, the usual ones by default,
+ * and rank them.  The audio is read and rectified once; each rate
+ * gets its own libregulator context and thread.
+ */
+void regulator_guess_run(struct regulator_t* rp, int argc, char* const argv[]) {
+    regulator_guess_t guess = { .rp = rp };
+    regulator_guess_rate_t* gp;
+    size_t ticks_per_hour = rp->ticks_per_hour;
+    size_t total = 0;
+    size_t frames;
+    size_t slot;
+    size_t i;
+    int16_t* block;
+    char* end;
+    float drift;
+
+    /* whole seconds at a time, which any sample rate divides into */
+    rp->no_sample_sort_buffer = 1;
+    rp->ticks_per_hour = 3600;
+    regulator_choose_backend(rp)->open(rp);
+
+    for (i = 0; i < (size_t)argc; i += 1) {
+        long value = strtol(argv[i], &end, 10);
+        if (*end || value < 1) {
+            fprintf(stderr, "%s: guess: invalid ticks per hour: %s\n",
+                    rp->progname, argv[i]);
+            exit(1);
+        }
+        regulator_guess_add(rp, &guess, (size_t)value, 0);
+    }
+    for (i = 0; !argc && regulator_guess_defaults[i]; i += 1) {
+        regulator_guess_add(rp, &guess, regulator_guess_defaults[i], 1);
+    }
+    if (!guess.rate_count) {
+        fprintf(stderr, "%s: guess: no rate to try\n", rp->progname);
+        exit(1);
+    }
+
+    for (i = 0; i < GUESS_BLOCKS; i += 1) {
+        guess.blocks[i] = (int16_t*)malloc(sizeof(int16_t) *
+                                           GUESS_BLOCK_FRAMES);
+        if (!guess.blocks[i]) {
+            perror(rp->progname);
+            exit(1);
+        }
+    }
+    if ((errno = pthread_mutex_init(&(guess.lock), NULL)) ||
+        (errno = pthread_cond_init(&(guess.cond), NULL))) {
+        perror(rp->progname);
+        exit(1);
+    }
+    for (i = 0; i < guess.rate_count; i += 1) {
+        if ((errno = pthread_create(&(guess.rates[i].thread), NULL,
+                                    regulator_guess_thread,
+                                    guess.rates + i))) {
+            perror(rp->progname);
+            exit(1);
+        }
+    }
+
+    /* this thread reads; the slot is the producer's until written moves */
+    pthread_mutex_lock(&(guess.lock));
+    while (total < GUESS_SECONDS * rp->frames_per_second &&
+           !regulator_guess_all_done(&guess)) {
+        if (!regulator_guess_slot_free(&guess)) {
+            pthread_cond_wait(&(guess.cond), &(guess.lock));
+            continue;
+        }
+        slot = guess.written % GUESS_BLOCKS;
+        block = guess.blocks[slot];
+        pthread_mutex_unlock(&(guess.lock));
+
+        frames = GUESS_SECONDS * rp->frames_per_second - total;
+        if (frames > GUESS_BLOCK_FRAMES) {
+            frames = GUESS_BLOCK_FRAMES;
+        }
+        frames = rp->backend->read(rp, block, frames);
+        total += frames;
+
+        pthread_mutex_lock(&(guess.lock));
+        if (!frames) {
+            break;
+        }
+        guess.frames[slot] = frames;
+        guess.written += 1;
+        pthread_cond_broadcast(&(guess.cond));
+    }
+    guess.eof = 1;
+    pthread_cond_broadcast(&(guess.cond));
+    pthread_mutex_unlock(&(guess.lock));
+
+    for (i = 0; i < guess.rate_count; i += 1) {
+        gp = guess.rates + i;
+        pthread_join(gp->thread, NULL);
+        gp->status = regulator_lib_fit(gp->lp, &(gp->result));
+        if (gp->status == REGULATOR_LIB_NOMEM) {
+            perror(rp->progname);
+            exit(1);
+        }
+        gp->good_ratio = gp->result.ticks ?
+            (double)gp->result.good_ticks / gp->result.ticks : 0;
+        if (!gp->status) {
+            gp->scatter = regulator_guess_scatter(rp, gp);
+            gp->score = regulator_guess_score(gp);
+        }
+    }
+    if (rp->debug >= 1) {
+        printf("guess: %.1f seconds read by the %s backend\n",
+               (double)total / rp->frames_per_second, rp->backend->name);
+    }
+
+    qsort(guess.rates, guess.rate_count, sizeof(regulator_guess_rate_t),
+          (qsort_function)regulator_guess_sort);
+    for (i = 0; i < guess.rate_count; i += 1) {
+        gp = guess.rates + i;
+        printf("%6d ticks per hour: %5.1f%% good", (int)gp->ticks_per_hour,
+               gp->good_ratio * 100);
+        if (gp->status) {
+            printf(", %s\n", regulator_lib_strerror(gp->status));
+            continue;
+        }
+        drift = (float)gp->result.drift;
+        printf(", %.3f ms scatter, %f seconds %s\n", gp->scatter,
+               (double)(drift < 0 ? -drift : drift),
+               (drift < 0 ? "slow" : "fast"));
+    }
+    if (!guess.rates[0].status) {
+        printf("best guess: --ticks-per-hour=%d\n",
+               (int)guess.rates[0].ticks_per_hour);
+    }
+
+    for (i = 0; i < guess.rate_count; i += 1) {
+        regulator_lib_free(guess.rates[i].lp);
+    }
+    for (i = 0; i < GUESS_BLOCKS; i += 1) {
+        free(guess.blocks[i]);
+    }
+    pthread_cond_destroy(&(guess.cond));
+    pthread_mutex_destroy(&(guess.lock));
+    rp->ticks_per_hour = ticks_per_hour;
+}
@@ -0,0 +1,50 @@
+#ifndef REGULATOR_GUESS_H
+#define REGULATOR_GUESS_H
+
+#include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "regulator_types.h"
+#include "regulator_lib.h"
+
+#define GUESS_SECONDS      120   /* plenty to tell the rates apart */
+#define GUESS_BLOCK_FRAMES 16384
+#define GUESS_BLOCKS       8
+#define GUESS_MAX_RATES    16
+
+/* one candidate beat rate, in its own libregulator context */
+typedef struct regulator_guess_rate_t {
+    struct regulator_guess_t* guess;
+    size_t ticks_per_hour;
+    regulator_lib_t* lp;
+    int    status;
+    size_t consumed;            /* blocks fed so far */
+    int    done;
+    regulator_lib_result_t result;
+    double good_ratio;
+    double scatter;             /* ms, median distance from the fit */
+    double score;               /* see regulator_guess_sort */
+    pthread_t thread;
+} regulator_guess_rate_t;
+
+/**
+ * Blocks are read once into a ring that every rate's thread reads.
+ * A slot is refilled only once each rate that isn't done has been
+ * fed it.
+ */
+typedef struct regulator_guess_t {
+    struct regulator_t* rp;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    int16_t* blocks[GUESS_BLOCKS];
+    size_t   frames[GUESS_BLOCKS];
+    size_t   written;           /* blocks read so far */
+    int      eof;
+    regulator_guess_rate_t rates[GUESS_MAX_RATES];
+    size_t   rate_count;
+} regulator_guess_t;
+
+void regulator_guess_run(struct regulator_t* rp, int argc, char* const argv[]);
+
+#endif  /* REGULATOR_GUESS_H */
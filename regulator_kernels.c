@@ -0,0 +1,207 @@
+/**
+ * regulator_kernels.c --- peak finding, specialized per beat rate
+ *
+ * Copyright (C) 2019 Darren Embry.  GPL2.
+ */
+
+#define REGULATOR_KERNELS_C
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "regulator.h"
+#include "regulator_kernels.h"
+#include "regulator_noise.h"
+
+/* fixed trip count, so this vectorizes even at -O2 */
+static inline __attribute__((always_inline))
+int16_t regulator_kernel_block_max(const int16_t* samples) {
+    int16_t max = 0;
+    for (size_t i = 0; i < KERNEL_BLOCK_SAMPLES; i += 1) {
+        max = samples[i] > max ? samples[i] : max;
+    }
+    return max;
+}
+
+/* is sample a at index ia louder than b, ties going to the earlier? */
+#define KERNEL_BEATS(a, ia, b) \
+    ((a) > (b).sample || ((a) == (b).sample && (ia) < (b).index))
+
+static inline __attribute__((always_inline))
+void regulator_kernel_scan(const int16_t* samples, size_t start, size_t end,
+                           regulator_sample_t* top, size_t* countp) {
+    size_t count = *countp;
+    size_t i;
+    size_t j;
+    for (i = start; i < end; i += 1) {
+        if (count == PEAK_SAMPLES &&
+            !KERNEL_BEATS(samples[i], i, top[PEAK_SAMPLES - 1])) {
+            continue;
+        }
+        j = (count < PEAK_SAMPLES) ? count++ : PEAK_SAMPLES - 1;
+        for (; j > 0 && KERNEL_BEATS(samples[i], i, top[j - 1]); j -= 1) {
+            top[j] = top[j - 1];
+        }
+        top[j].sample = samples[i];
+        top[j].index = i;
+    }
+    *countp = count;
+}
+
+/**
+ * Finds the PEAK_SAMPLES loudest samples of one tick, ties going to
+ * the earlier sample, and from them the tick's peak.
+ *
+ * A vectorized pass takes each block's maximum; a window with
+ * nothing above the noise floor stops there.  The loudest block
+ * is scanned first, which usually sets the bar at the tick itself, so
+ * that every block of background noise after it is skipped on its
+ * maximum alone.
+ *
+ * Always inlined so that each caller with a constant
+ * samples_per_tick gets the window length, the block count and every
+ * threshold folded in.
+ */
+static inline __attribute__((always_inline))
+void regulator_kernel_body(struct regulator_t* rp,
+                           const size_t samples_per_tick) {
+    const size_t blocks =
+        (samples_per_tick + KERNEL_BLOCK_SAMPLES - 1) / KERNEL_BLOCK_SAMPLES;
+    const size_t full_blocks = samples_per_tick / KERNEL_BLOCK_SAMPLES;
+    const int16_t* samples = rp->buffer_analyze;
+    regulator_sample_t* top = rp->sample_sort_buffer;
+    int16_t block_maxes[blocks];
+    size_t peak_sample_indexes[PEAK_SAMPLES];
+    size_t loudest_block = 0;
+    int16_t loudest = 0;
+    size_t count = 0;
+    size_t block;
+    size_t end;
+    size_t i;
+    size_t j;
+    size_t index;
+    size_t low_indexes = 0;
+    size_t high_indexes = 0;
+
+    const size_t way_off =
+        samples_per_tick * PEAK_WAY_OFF_THRESHOLD_1 / PEAK_SAMPLES;
+    const size_t early_point =
+        samples_per_tick * SHIFT_POINT_PERCENT / 100;
+    const size_t late_point =
+        samples_per_tick * (100 - SHIFT_POINT_PERCENT) / 100;
+
+    for (block = 0; block < full_blocks; block += 1) {
+        block_maxes[block] =
+            regulator_kernel_block_max(samples + block * KERNEL_BLOCK_SAMPLES);
+    }
+    if (full_blocks < blocks) {
+        block_maxes[full_blocks] = 0;
+        for (i = full_blocks * KERNEL_BLOCK_SAMPLES; i < samples_per_tick;
+             i += 1) {
+            if (block_maxes[full_blocks] < samples[i]) {
+                block_maxes[full_blocks] = samples[i];
+            }
+        }
+    }
+    for (block = 0; block < blocks; block += 1) {
+        if (block_maxes[block] > loudest) {
+            loudest = block_maxes[block];
+            loudest_block = block;
+        }
+    }
+    if (regulator_noise_gate(rp, block_maxes, blocks, loudest)) {
+        rp->buffer_analyze += samples_per_tick;
+        return;
+    }
+
+    for (i = 0; i < blocks; i += 1) {
+        block = (i == 0) ? loudest_block : (i <= loudest_block) ? i - 1 : i;
+        if (count == PEAK_SAMPLES &&
+            block_maxes[block] < top[PEAK_SAMPLES - 1].sample) {
+            continue;
+        }
+        end = (block + 1) * KERNEL_BLOCK_SAMPLES;
+        regulator_kernel_scan(samples, block * KERNEL_BLOCK_SAMPLES,
+                              end < samples_per_tick ? end : samples_per_tick,
+                              top, &count);
+    }
+
+    rp->buffer_analyze += samples_per_tick;
+
+    for (i = 0; i < PEAK_SAMPLES; i += 1) {
+        index = top[i].index;
+        if (index < way_off) {
+            low_indexes += 1;
+        } else if ((samples_per_tick - index) <= way_off) {
+            high_indexes += 1;
+        }
+        /* insertion sort; there are only PEAK_SAMPLES of them */
+        for (j = i; j > 0 && peak_sample_indexes[j - 1] > index; j -= 1) {
+            peak_sample_indexes[j] = peak_sample_indexes[j - 1];
+        }
+        peak_sample_indexes[j] = index;
+    }
+
+    /* heuristic */
+    rp->this_tick_peak_at_boundary = (
+        (low_indexes >= (PEAK_WAY_OFF_THRESHOLD_2) &&
+         high_indexes >= (PEAK_WAY_OFF_THRESHOLD_2)) ||
+        low_indexes >= (PEAK_WAY_OFF_THRESHOLD_2 * 2) ||
+        high_indexes >= (PEAK_WAY_OFF_THRESHOLD_2 * 2)
+    );
+
+    size_t lowest_index  =
+        peak_sample_indexes[PEAK_WAY_OFF_THRESHOLD_2];
+    size_t highest_index =
+        peak_sample_indexes[PEAK_SAMPLES - 1 - PEAK_WAY_OFF_THRESHOLD_2];
+    rp->this_tick_has_well_defined_peak =
+        ((highest_index - lowest_index) < way_off);
+    if (rp->this_tick_has_well_defined_peak) {
+        rp->this_tick_peak = (highest_index + lowest_index) / 2;
+        rp->this_tick_has_early_peak = (rp->this_tick_peak < early_point);
+        rp->this_tick_has_late_peak  = (rp->this_tick_peak >= late_point);
+    } else {
+        rp->this_tick_peak = SIZE_MAX;
+    }
+}
+
+void regulator_kernel_generic(struct regulator_t* rp) {
+    regulator_kernel_body(rp, rp->samples_per_tick);
+}
+
+/* only pairs where 3600 * rate / ticks_per_hour is a whole number */
+#define REGULATOR_KERNELS(X)                    \
+    X(44100, 18000)                             \
+    X(44100, 21600)                             \
+    X(44100, 25200)                             \
+    X(44100, 36000)                             \
+    X(48000, 18000)                             \
+    X(48000, 21600)                             \
+    X(48000, 28800)                             \
+    X(48000, 36000)
+
+#define REGULATOR_KERNEL_DEFINE(RATE, TICKS_PER_HOUR)                   \
+    static void regulator_kernel_##RATE##_##TICKS_PER_HOUR(             \
+        struct regulator_t* rp) {                                       \
+        regulator_kernel_body(rp, 3600 * RATE / TICKS_PER_HOUR);        \
+    }
+REGULATOR_KERNELS(REGULATOR_KERNEL_DEFINE)
+
+#define REGULATOR_KERNEL_ENTRY(RATE, TICKS_PER_HOUR)                    \
+    { RATE, TICKS_PER_HOUR, regulator_kernel_##RATE##_##TICKS_PER_HOUR },
+const regulator_kernel_entry_t regulator_kernels[] = {
+    REGULATOR_KERNELS(REGULATOR_KERNEL_ENTRY)
+    { 0, 0, NULL }
+};
+
+/* quietly, as libregulator calls it too */
+regulator_kernel_t regulator_choose_kernel(struct regulator_t* rp) {
+    const regulator_kernel_entry_t* kp;
+    for (kp = regulator_kernels; kp->kernel; kp += 1) {
+        if (kp->frames_per_second == rp->frames_per_second &&
+            kp->ticks_per_hour == rp->ticks_per_hour) {
+            return kp->kernel;
+        }
+    }
+    return regulator_kernel_generic;
+}
@@ -0,0 +1,21 @@
+#ifndef REGULATOR_KERNELS_H
+#define REGULATOR_KERNELS_H
+
+#include <unistd.h>
+
+#include "regulator_types.h"
+
+#define KERNEL_BLOCK_SAMPLES 64
+
+typedef struct regulator_kernel_entry_t {
+    size_t frames_per_second;
+    size_t ticks_per_hour;
+    regulator_kernel_t kernel;
+} regulator_kernel_entry_t;
+
+extern const regulator_kernel_entry_t regulator_kernels[];
+
+regulator_kernel_t regulator_choose_kernel(struct regulator_t* rp);
+void regulator_kernel_generic(struct regulator_t* rp);
+
+#endif  /* REGULATOR_KERNELS_H */
@@ -0,0 +1,347 @@
+/**
+ * regulator_lib.c --- libregulator, the analysis without the program
+ * around it
+ *
+ * Copyright (C) 2019 Darren Embry.  GPL2.
+ */
+
+#define REGULATOR_LIB_C
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "regulator.h"
+#include "regulator_kernels.h"
+#include "regulator_fit.h"
+#include "regulator_lib.h"
+
+/**
+ * Positions are counted in frames since the first one fed.  The
+ * buffer holds TICKS_PER_GROUP + 1 ticks, as regulator_run's does,
+ * so the first batch can be analyzed over again half a tick later.
+ */
+struct regulator_lib_t {
+    regulator_t r;
+    size_t base;                /* position of r.buffer[0] */
+    size_t have;                /* position of r.buffer_append */
+    size_t next;                /* position of the next tick window */
+    int    started;             /* first batch of ticks accepted */
+    int    retried;             /* first batch shifted by half a tick */
+    int    early_peak_count;
+    int    late_peak_count;
+    int    status;              /* REGULATOR_LIB_NO_TICKS sticks */
+};
+
+int regulator_lib_new(regulator_lib_t** lpp,
+                      size_t frames_per_second, size_t ticks_per_hour) {
+    regulator_lib_t* lp;
+    regulator_t* rp;
+
+    *lpp = NULL;
+    if (!frames_per_second || !ticks_per_hour ||
+        (3600 * frames_per_second) % ticks_per_hour ||
+        3600 * frames_per_second / ticks_per_hour < PEAK_SAMPLES) {
+        return REGULATOR_LIB_INVALID;
+    }
+    if (!(lp = (regulator_lib_t*)calloc(1, sizeof(regulator_lib_t)))) {
+        return REGULATOR_LIB_NOMEM;
+    }
+    rp = &(lp->r);
+    rp->progname          = "libregulator";
+    rp->embedded          = 1;
+    rp->frames_per_second = frames_per_second;
+    rp->ticks_per_hour    = ticks_per_hour;
+    rp->samples_per_tick  = 3600 * frames_per_second / ticks_per_hour;
+    rp->buffer_ticks      = TICKS_PER_GROUP + 1;
+    rp->buffer_samples    = rp->buffer_ticks * rp->samples_per_tick;
+    rp->analyze_kernel    = regulator_choose_kernel(rp);
+
+    rp->buffer = (int16_t*)malloc(sizeof(int16_t) * rp->buffer_samples);
+    rp->tick_peak_data =
+        (tick_peak_t*)malloc(sizeof(tick_peak_t) * ticks_per_hour);
+    rp->sample_sort_buffer =
+        (regulator_sample_t*)malloc(sizeof(regulator_sample_t) * PEAK_SAMPLES);
+    if (!rp->buffer || !rp->tick_peak_data || !rp->sample_sort_buffer) {
+        regulator_lib_free(lp);
+        return REGULATOR_LIB_NOMEM;
+    }
+    rp->buffer_end    = rp->buffer + rp->buffer_samples;
+    rp->buffer_append = rp->buffer;
+
+    *lpp = lp;
+    return REGULATOR_LIB_OK;
+}
+
+void regulator_lib_free(regulator_lib_t* lp) {
+    if (!lp) {
+        return;
+    }
+    free(lp->r.buffer);
+    free(lp->r.tick_peak_data);
+    free(lp->r.sample_sort_buffer);
+    free(lp);
+}
+
+/* regulator_analyze_tick, less the output, --timeline and --drift-window */
+static void regulator_lib_analyze_tick(regulator_lib_t* lp) {
+    regulator_t* rp = &(lp->r);
+
+    rp->buffer_analyze = rp->buffer + (lp->next - lp->base);
+    rp->analyze_kernel(rp);
+    lp->next += rp->samples_per_tick;
+
+    if (rp->this_tick_peak_at_boundary) {
+        rp->boundary_peak_count += 1;
+    } else if (rp->this_tick_has_well_defined_peak) {
+        rp->tick_peak_data[rp->tick_peak_count].index = rp->tick_count;
+        rp->tick_peak_data[rp->tick_peak_count].peak =
+            (ssize_t)rp->this_tick_peak - rp->peak_offset;
+        ls_fit_add(&(rp->precision_sums),
+                   rp->tick_peak_data[rp->tick_peak_count].index,
+                   rp->tick_peak_data[rp->tick_peak_count].peak);
+        rp->tick_peak_count += 1;
+        rp->good_tick_count += 1;
+    } else if (rp->this_tick_is_quiet) {
+        rp->quiet_tick_count += 1;
+    } else {
+        rp->ill_defined_tick_count += 1;
+    }
+    rp->tick_count += 1;
+}
+
+static void regulator_lib_reset_counts(regulator_lib_t* lp) {
+    regulator_t* rp = &(lp->r);
+    rp->tick_count = 0;
+    rp->good_tick_count = 0;
+    rp->tick_peak_count = 0;
+    rp->boundary_peak_count = 0;
+    rp->quiet_tick_count = 0;
+    rp->ill_defined_tick_count = 0;
+    rp->peak_offset = 0;
+    memset(&(rp->precision_sums), 0, sizeof(regulator_precision_t));
+}
+
+/**
+ * The same decisions regulator_run makes between reads, made on
+ * stream positions instead: after the first batch, whether to start
+ * over half a tick later; after that, whether to move the window.
+ */
+static void regulator_lib_step(regulator_lib_t* lp) {
+    regulator_t* rp = &(lp->r);
+    size_t spt = rp->samples_per_tick;
+    size_t extra;
+
+    regulator_lib_analyze_tick(lp);
+
+    if (!lp->started) {
+        if (rp->tick_count < TICKS_PER_GROUP) {
+            return;
+        }
+        if (rp->boundary_peak_count >= (TICKS_PER_GROUP * 3 / 4)) {
+            if (lp->retried) {
+                lp->status = REGULATOR_LIB_NO_TICKS;
+            } else {
+                lp->retried = 1;
+                lp->next = spt / 2;
+                regulator_lib_reset_counts(lp);
+                /* so peaks still count from the start of the stream */
+                rp->peak_offset = -(ssize_t)(spt / 2);
+            }
+            return;
+        }
+        lp->started = 1;
+    }
+
+    if (rp->this_tick_has_well_defined_peak) {
+        if (rp->this_tick_has_early_peak) {
+            lp->early_peak_count += 1;
+            lp->late_peak_count = 0;
+        } else if (rp->this_tick_has_late_peak) {
+            lp->early_peak_count = 0;
+            lp->late_peak_count += 1;
+        } else {
+            lp->early_peak_count = 0;
+            lp->late_peak_count = 0;
+        }
+    }
+    if (lp->early_peak_count >= 3) {
+        extra = spt * SHIFT_POINT_PERCENT * 3 / 100;
+        lp->next += extra - spt;
+        rp->peak_offset += spt - extra;
+        lp->early_peak_count = 0;
+        lp->late_peak_count = 0;
+    } else if (lp->late_peak_count >= 3) {
+        extra = spt * (100 - SHIFT_POINT_PERCENT * 3) / 100;
+        lp->next += extra;
+        rp->peak_offset -= extra;
+        lp->early_peak_count = 0;
+        lp->late_peak_count = 0;
+    }
+}
+
+/* room for more, once the first batch no longer needs what's behind */
+static void regulator_lib_make_room(regulator_lib_t* lp) {
+    regulator_t* rp = &(lp->r);
+    size_t keep = (lp->next < lp->have) ? lp->next : lp->have;
+    size_t drop = keep - lp->base;
+
+    if (!lp->started || !drop) {
+        return;
+    }
+    memmove(rp->buffer, rp->buffer + drop,
+            sizeof(int16_t) * (lp->have - keep));
+    rp->buffer_append -= drop;
+    lp->base = keep;
+}
+
+/**
+ * Channel 0 of count interleaved frames of signed 16-bit PCM.  Every
+ * tick window completed is analyzed before this returns.
+ */
+int regulator_lib_feed(regulator_lib_t* lp,
+                       const int16_t* frames, size_t count, size_t channels) {
+    regulator_t* rp;
+    size_t room;
+    size_t i;
+    int16_t sample;
+
+    if (!lp || !channels || (count && !frames)) {
+        return REGULATOR_LIB_INVALID;
+    }
+    if (lp->status) {
+        return lp->status;
+    }
+    rp = &(lp->r);
+    while (count && rp->tick_count < rp->ticks_per_hour) {
+        if (rp->buffer_append == rp->buffer_end) {
+            regulator_lib_make_room(lp);
+        }
+        room = rp->buffer_end - rp->buffer_append;
+        if (room > count) {
+            room = count;
+        }
+        for (i = 0; i < room; i += 1) {
+            sample = frames[i * channels];
+            if (sample == INT16_MIN) { /* -32768 => 32767 */
+                sample = INT16_MAX;
+            } else if (sample < 0) {
+                sample = -sample;
+            }
+            rp->buffer_append[i] = sample;
+        }
+        rp->buffer_append += room;
+        lp->have += room;
+        frames += room * channels;
+        count -= room;
+
+        while (lp->next + rp->samples_per_tick <= lp->have &&
+               rp->tick_count < rp->ticks_per_hour) {
+            regulator_lib_step(lp);
+            if (lp->status) {
+                return lp->status;
+            }
+        }
+    }
+    return REGULATOR_LIB_OK;
+}
+
+/* the counts so far, and whether there's enough for a fit */
+static int regulator_lib_counts(regulator_lib_t* lp,
+                                regulator_lib_result_t* result) {
+    regulator_t* rp = &(lp->r);
+
+    memset(result, 0, sizeof(*result));
+    result->ticks             = rp->tick_count;
+    result->good_ticks        = rp->good_tick_count;
+    result->quiet_ticks       = rp->quiet_tick_count;
+    result->boundary_ticks    = rp->boundary_peak_count;
+    result->ill_defined_ticks = rp->ill_defined_tick_count;
+    result->done = (lp->status || rp->tick_count >= rp->ticks_per_hour);
+    if (lp->status) {
+        return lp->status;
+    }
+    if (!lp->started || rp->tick_peak_count < 2) {
+        return REGULATOR_LIB_NOT_READY;
+    }
+    return REGULATOR_LIB_OK;
+}
+
+static double regulator_lib_drift(regulator_lib_t* lp, float slope) {
+    return -(double)slope / lp->r.frames_per_second * lp->r.ticks_per_hour * 24;
+}
+
+/**
+ * The least-squares line through every good tick so far, from sums
+ * kept as they come: O(1), however long the context has run, and
+ * nothing allocated, so it can be called as often as wanted.
+ */
+int regulator_lib_poll(regulator_lib_t* lp, regulator_lib_result_t* result) {
+    int status;
+
+    if (!lp || !result) {
+        return REGULATOR_LIB_INVALID;
+    }
+    if ((status = regulator_lib_counts(lp, result))) {
+        return status;
+    }
+    result->drift =
+        regulator_lib_drift(lp, ls_fit_slope(&(lp->r.precision_sums)));
+    return REGULATOR_LIB_OK;
+}
+
+/**
+ * The Kendall-Theil fit over every good tick so far, as
+ * regulator_result, which outliers move less.  It takes the slope
+ * between every pair of ticks, so O(n^2) time and memory: for the
+ * end of a run, not for polling.
+ */
+int regulator_lib_fit(regulator_lib_t* lp, regulator_lib_result_t* result) {
+    float slope;
+    int status;
+
+    if (!lp || !result) {
+        return REGULATOR_LIB_INVALID;
+    }
+    if ((status = regulator_lib_counts(lp, result))) {
+        return status;
+    }
+    if (kt_best_fit(lp->r.tick_peak_data, lp->r.tick_peak_count, &slope)) {
+        return REGULATOR_LIB_NOMEM;
+    }
+    result->drift = regulator_lib_drift(lp, slope);
+    return REGULATOR_LIB_OK;
+}
+
+/* the good ticks so far, oldest first; returns how many were copied */
+size_t regulator_lib_peaks(regulator_lib_t* lp,
+                           regulator_lib_peak_t* peaks, size_t max) {
+    size_t i;
+    if (!lp || !peaks) {
+        return 0;
+    }
+    if (max > lp->r.tick_peak_count) {
+        max = lp->r.tick_peak_count;
+    }
+    for (i = 0; i < max; i += 1) {
+        peaks[i].tick = lp->r.tick_peak_data[i].index;
+        peaks[i].peak = (long)lp->r.tick_peak_data[i].peak;
+    }
+    return max;
+}
+
+const char* regulator_lib_strerror(int status) {
+    switch (status) {
+    case REGULATOR_LIB_OK:
+        return "success";
+    case REGULATOR_LIB_NOMEM:
+        return "out of memory";
+    case REGULATOR_LIB_INVALID:
+        return "invalid argument";
+    case REGULATOR_LIB_NOT_READY:
+        return "not enough data yet";
+    case REGULATOR_LIB_NO_TICKS:
+        return "no clear ticks";
+    default:
+        return "unknown error";
+    }
+}
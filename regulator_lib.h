@@ -0,0 +1,52 @@
+#ifndef REGULATOR_LIB_H
+#define REGULATOR_LIB_H
+
+/**
+ * libregulator: the tick analysis, fed samples by the caller.
+ *
+ * Contexts share nothing, so each may run on its own thread; one
+ * context must not be used from two threads at once.  Nothing here
+ * prints, exits, or installs signal handlers.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum regulator_lib_status_t {
+    REGULATOR_LIB_OK        =  0,
+    REGULATOR_LIB_NOMEM     = -1,
+    REGULATOR_LIB_INVALID   = -2, /* bad argument or sample rate */
+    REGULATOR_LIB_NOT_READY = -3, /* not enough ticks for a result yet */
+    REGULATOR_LIB_NO_TICKS  = -4  /* no clear ticks; the context is done */
+} regulator_lib_status_t;
+
+typedef struct regulator_lib_t regulator_lib_t;
+
+/* tick * samples per tick + peak is the frame the tick's peak fell on */
+typedef struct regulator_lib_peak_t {
+    size_t tick;
+    long   peak;
+} regulator_lib_peak_t;
+
+typedef struct regulator_lib_result_t {
+    double drift;               /* seconds per day, + fast, - slow */
+    size_t ticks;               /* tick windows analyzed */
+    size_t good_ticks;          /* those that went into the fit */
+    size_t quiet_ticks;         /* below the noise floor */
+    size_t boundary_ticks;      /* peak at the edge of the window */
+    size_t ill_defined_ticks;   /* no clear peak */
+    int    done;                /* an hour's worth; further samples ignored */
+} regulator_lib_result_t;
+
+int regulator_lib_new(regulator_lib_t** lpp,
+                      size_t frames_per_second, size_t ticks_per_hour);
+int regulator_lib_feed(regulator_lib_t* lp,
+                       const int16_t* frames, size_t count, size_t channels);
+int regulator_lib_poll(regulator_lib_t* lp, regulator_lib_result_t* result);
+int regulator_lib_fit(regulator_lib_t* lp, regulator_lib_result_t* result);
+size_t regulator_lib_peaks(regulator_lib_t* lp,
+                           regulator_lib_peak_t* peaks, size_t max);
+void regulator_lib_free(regulator_lib_t* lp);
+const char* regulator_lib_strerror(int status);
+
+#endif  /* REGULATOR_LIB_H */
@@ -11,10 +11,18 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <sched.h>
 
 #include "regulator.h"
 #include "regulator_main.h"
-#include "regulator_pulseaudio.h"
+#include "regulator_multi.h"
+#include "regulator_raw.h"
+#include "regulator_timeline.h"
+#include "regulator_drift.h"
+#include "regulator_vu.h"
+#include "regulator_sparse.h"
+#include "regulator_guess.h"
+#include "regulator_bench.h"
 
 int main(int argc, char* const argv[]) {
     regulator_t r = {};
@@ -24,13 +32,39 @@ int main(int argc, char* const argv[]) {
                       !strcmp(argv[0], "vu") ||
                       !strcmp(argv[0], "test-mic") ||
                       !strcmp(argv[0], "mic"))) {
-        regulator_pulseaudio_test(&r);
+        regulator_vu_run(&r);
+        exit(0);
+    }
+    if (argc >= 1 && !strcmp(argv[0], "replay")) {
+        regulator_timeline_replay(&r, argc - 1, argv + 1);
+        exit(0);
+    }
+    if (argc >= 1 && !strcmp(argv[0], "bench")) {
+        regulator_bench_run(&r);
+        exit(0);
+    }
+    if (argc >= 1 && !strcmp(argv[0], "guess")) {
+        regulator_guess_run(&r, argc - 1, argv + 1);
+        regulator_cleanup(&r);
+        exit(0);
+    }
+    if (argc >= 1 && !strcmp(argv[0], "multi")) {
+        regulator_multi_run(&r, argc - 1, argv + 1);
         exit(0);
     }
     if (!r.ticks_per_hour) {
         fprintf(stderr, "%s: --ticks-per-hour is required\n", r.progname);
         exit(1);
     }
+    if (r.daemon && !r.socket_path) {
+        fprintf(stderr, "%s: --daemon needs --socket\n", r.progname);
+        exit(1);
+    }
+    if (r.sparse_window) {
+        regulator_sparse_run(&r);
+        regulator_cleanup(&r);
+        exit(0);
+    }
     regulator_run(&r);
     regulator_cleanup(&r);
 }
@@ -48,7 +82,6 @@ char* regulator_set_progname(struct regulator_t* rp,
             rp->progname = p + 1;
         }
     }
-    progname = rp->progname;
     return rp->progname;
 }
 
@@ -57,12 +90,60 @@ void regulator_usage(struct regulator_t* rp) {
     puts("usage: regulator [<option> ...] [<command>]");
     puts("commands:");
     puts("    test");
-    puts("    guess");
+    puts("    guess [<ticks-per-hour> ...]");
     puts("    run");
+    puts("    vu");
+    puts("    multi <source>[:<ticks-per-hour>] ...");
+    puts("    replay <timeline-file> [<first-tick>-[<last-tick>] ...]");
+    puts("    bench");
     puts("options:");
     puts("    -h, --help                      display this message");
     puts("    -f, --file=<file>               read data from sound file");
+    puts("                                    (\"-\" for standard input)");
+    puts("        --raw[=<format>]            input is headerless PCM:");
+    puts("                                    s16le (default), s32le, f32le");
+    puts("        --rate=<frames>             --raw sample rate (44100)");
+    puts("        --channels=<channels>       --raw channel count (1)");
     puts("        --ticks-per-hour=<ticks>    specify ticks per hour");
+    puts("        --progressive               show provisional results from the");
+    puts("                                    first few ticks");
+    puts("        --ticks-rate=<frames>       draw each tick, at most <frames>");
+    puts("                                    times a second");
+    puts("        --backend=<name>            pulseaudio (default) or alsa");
+    puts("        --device=<name>             capture device");
+    puts("        --timeline=<file>           save each tick's result");
+    puts("        --trace=<file>              draw the timegrapher trace as a");
+    puts("                                    PGM image, redrawn every 10");
+    puts("                                    seconds (\"-\" for the terminal)");
+    puts("        --record=<file>             save what is captured, as WAV,");
+    puts("                                    or FLAC or Ogg by extension;");
+    puts("                                    not with multi");
+    puts("        --cache[=<dir>]             keep decoded sound files in");
+    puts("                                    <dir> (~/.cache/regulator)");
+    puts("        --cache-size=<megabytes>    cache size limit (1024)");
+    puts("        --decode-threads=<count>    threads decoding a FLAC or Ogg");
+    puts("                                    file (one per CPU)");
+    puts("        --confidence[=<percent>]    show a bootstrap confidence");
+    puts("                                    interval for the result (95)");
+    puts("        --drift-window=<seconds>    also show the rate over the last");
+    puts("                                    <seconds> (may be repeated)");
+    puts("        --drift-history=<file>      save each window's rate every");
+    puts("                                    10 seconds of the run");
+    puts("        --precision=<sec>           stop once the result is known to");
+    puts("                                    +/-<sec> seconds per day (95%)");
+    puts("        --daemon                    keep going past the hour, until");
+    puts("                                    killed or out of data");
+    puts("        --socket=<path>             serve the results so far on a");
+    puts("                                    Unix domain socket (required");
+    puts("                                    with --daemon)");
+    puts("        --realtime[=<priority>]     preallocate and lock memory, and");
+    puts("                                    run under SCHED_FIFO at");
+    puts("                                    <priority> if given");
+    puts("        --highpass=<Hz>             filter out rumble below <Hz>");
+    puts("        --lowpass=<Hz>              filter out hiss above <Hz>");
+    puts("        --sparse[=<sec>/<sec>]      analyze only a window of the first");
+    puts("                                    <sec> every second <sec> of a file");
+    puts("                                    (60/600)");
 }
 #pragma GCC diagnostic warning "-Wunused-parameter"
 
@@ -79,7 +160,30 @@ void regulator_options(struct regulator_t* rp,
         { "ticks-per-hour", required_argument, NULL, 0   },
         { "debug",          no_argument,       NULL, 'D' },
         { "stats",          no_argument,       NULL, 0   },
+        { "progressive",    no_argument,       NULL, 0   },
         { "ticks",          no_argument,       NULL, 0   },
+        { "ticks-rate",     required_argument, NULL, 0   },
+        { "raw",            optional_argument, NULL, 0   },
+        { "rate",           required_argument, NULL, 0   },
+        { "channels",       required_argument, NULL, 0   },
+        { "backend",        required_argument, NULL, 0   },
+        { "device",         required_argument, NULL, 0   },
+        { "timeline",       required_argument, NULL, 0   },
+        { "record",         required_argument, NULL, 0   },
+        { "cache",          optional_argument, NULL, 0   },
+        { "cache-size",     required_argument, NULL, 0   },
+        { "decode-threads", required_argument, NULL, 0   },
+        { "confidence",     optional_argument, NULL, 0   },
+        { "drift-window",   required_argument, NULL, 0   },
+        { "drift-history",  required_argument, NULL, 0   },
+        { "sparse",         optional_argument, NULL, 0   },
+        { "precision",      required_argument, NULL, 0   },
+        { "daemon",         no_argument,       NULL, 0   },
+        { "socket",         required_argument, NULL, 0   },
+        { "highpass",       required_argument, NULL, 0   },
+        { "lowpass",        required_argument, NULL, 0   },
+        { "trace",          required_argument, NULL, 0   },
+        { "realtime",       optional_argument, NULL, 0   },
         { NULL,             0,                 NULL, 0   }
     };
 
@@ -109,8 +213,206 @@ void regulator_options(struct regulator_t* rp,
                 rp->debug += 1;
             } else if (!strcmp(longoptname, "stats")) {
                 rp->show_stats += 1;
+            } else if (!strcmp(longoptname, "progressive")) {
+                rp->progressive = 1;
             } else if (!strcmp(longoptname, "ticks")) {
                 rp->show_ticks += 1;
+            } else if (!strcmp(longoptname, "ticks-rate")) {
+                rp->show_ticks += 1;
+                rp->ticks_rate = strtod(optarg, (char**)NULL);
+                if (rp->ticks_rate <= 0) {
+                    fprintf(stderr,
+                            "%s: invalid --ticks-rate value: %s\n",
+                            rp->progname, optarg);
+                    exit(1);
+                }
+            } else if (!strcmp(longoptname, "raw")) {
+                rp->raw_format = regulator_raw_parse_format(optarg);
+                if (!rp->raw_format) {
+                    fprintf(stderr,
+                            "%s: invalid --raw format: %s\n",
+                            rp->progname, optarg);
+                    exit(1);
+                }
+            } else if (!strcmp(longoptname, "backend")) {
+                if (rp->backend_name != NULL) {
+                    free(rp->backend_name);
+                }
+                if (!(rp->backend_name = strdup(optarg))) {
+                    perror(rp->progname);
+                    exit(1);
+                }
+            } else if (!strcmp(longoptname, "device")) {
+                if (rp->device != NULL) {
+                    free(rp->device);
+                }
+                if (!(rp->device = strdup(optarg))) {
+                    perror(rp->progname);
+                    exit(1);
+                }
+            } else if (!strcmp(longoptname, "timeline")) {
+                if (rp->timeline_filename != NULL) {
+                    free(rp->timeline_filename);
+                }
+                if (!(rp->timeline_filename = strdup(optarg))) {
+                    perror(rp->progname);
+                    exit(1);
+                }
+            } else if (!strcmp(longoptname, "trace")) {
+                if (rp->trace_filename != NULL) {
+                    free(rp->trace_filename);
+                }
+                if (!(rp->trace_filename = strdup(optarg))) {
+                    perror(rp->progname);
+                    exit(1);
+                }
+            } else if (!strcmp(longoptname, "record")) {
+                if (rp->record_filename != NULL) {
+                    free(rp->record_filename);
+                }
+                if (!(rp->record_filename = strdup(optarg))) {
+                    perror(rp->progname);
+                    exit(1);
+                }
+            } else if (!strcmp(longoptname, "cache")) {
+                rp->cache = 1;
+                if (optarg) {
+                    if (rp->cache_dir != NULL) {
+                        free(rp->cache_dir);
+                    }
+                    if (!(rp->cache_dir = strdup(optarg))) {
+                        perror(rp->progname);
+                        exit(1);
+                    }
+                }
+            } else if (!strcmp(longoptname, "cache-size")) {
+                long megabytes = strtol(optarg, (char**)NULL, 10);
+                if (megabytes < 1) {
+                    fprintf(stderr,
+                            "%s: invalid --cache-size value: %s\n",
+                            rp->progname, optarg);
+                    exit(1);
+                }
+                rp->cache_limit = (size_t)megabytes * 1024 * 1024;
+            } else if (!strcmp(longoptname, "decode-threads")) {
+                long threads = strtol(optarg, (char**)NULL, 10);
+                if (threads < 1) {
+                    fprintf(stderr,
+                            "%s: invalid --decode-threads value: %s\n",
+                            rp->progname, optarg);
+                    exit(1);
+                }
+                rp->decode_threads = (size_t)threads;
+            } else if (!strcmp(longoptname, "confidence")) {
+                rp->confidence = optarg ? strtod(optarg, (char**)NULL) : 95;
+                if (rp->confidence <= 0 || rp->confidence >= 100) {
+                    fprintf(stderr,
+                            "%s: invalid --confidence value: %s\n",
+                            rp->progname, optarg);
+                    exit(1);
+                }
+            } else if (!strcmp(longoptname, "realtime")) {
+                rp->realtime = 1;
+                if (optarg) {
+                    long priority = strtol(optarg, (char**)NULL, 10);
+                    if (priority < sched_get_priority_min(SCHED_FIFO) ||
+                        priority > sched_get_priority_max(SCHED_FIFO)) {
+                        fprintf(stderr,
+                                "%s: invalid --realtime priority: %s\n",
+                                rp->progname, optarg);
+                        exit(1);
+                    }
+                    rp->realtime_priority = (int)priority;
+                }
+            } else if (!strcmp(longoptname, "drift-window")) {
+                long seconds = strtol(optarg, (char**)NULL, 10);
+                if (seconds < 1) {
+                    fprintf(stderr,
+                            "%s: invalid --drift-window value: %s\n",
+                            rp->progname, optarg);
+                    exit(1);
+                }
+                regulator_drift_add_window(rp, (size_t)seconds);
+            } else if (!strcmp(longoptname, "drift-history")) {
+                if (rp->drift_history_filename != NULL) {
+                    free(rp->drift_history_filename);
+                }
+                if (!(rp->drift_history_filename = strdup(optarg))) {
+                    perror(rp->progname);
+                    exit(1);
+                }
+            } else if (!strcmp(longoptname, "precision")) {
+                const char* p = optarg;
+                if (!strncmp(p, "\xc2\xb1", 2)) { /* UTF-8 plus-minus */
+                    p += 2;
+                } else if (!strncmp(p, "+/-", 3)) {
+                    p += 3;
+                }
+                rp->precision = strtod(p, (char**)NULL);
+                if (rp->precision <= 0) {
+                    fprintf(stderr,
+                            "%s: invalid --precision value: %s\n",
+                            rp->progname, optarg);
+                    exit(1);
+                }
+            } else if (!strcmp(longoptname, "daemon")) {
+                rp->daemon = 1;
+            } else if (!strcmp(longoptname, "socket")) {
+                if (rp->socket_path != NULL) {
+                    free(rp->socket_path);
+                }
+                if (!(rp->socket_path = strdup(optarg))) {
+                    perror(rp->progname);
+                    exit(1);
+                }
+            } else if (!strcmp(longoptname, "highpass") ||
+                       !strcmp(longoptname, "lowpass")) {
+                double hz = strtod(optarg, (char**)NULL);
+                if (hz <= 0) {
+                    fprintf(stderr,
+                            "%s: invalid --%s value: %s\n",
+                            rp->progname, longoptname, optarg);
+                    exit(1);
+                }
+                if (!strcmp(longoptname, "highpass")) {
+                    rp->filter.highpass = hz;
+                } else {
+                    rp->filter.lowpass = hz;
+                }
+            } else if (!strcmp(longoptname, "sparse")) {
+                long window = SPARSE_DEFAULT_WINDOW;
+                long interval = SPARSE_DEFAULT_INTERVAL;
+                char* end = optarg;
+                if (optarg) {
+                    window = strtol(optarg, &end, 10);
+                    if (*end == '/') {
+                        interval = strtol(end + 1, &end, 10);
+                    }
+                }
+                if ((optarg && *end) || window < 1 || interval < 1) {
+                    fprintf(stderr,
+                            "%s: invalid --sparse value: %s\n",
+                            rp->progname, optarg);
+                    exit(1);
+                }
+                rp->sparse_window = (size_t)window;
+                rp->sparse_interval = (size_t)interval;
+            } else if (!strcmp(longoptname, "rate")) {
+                rp->raw_rate = (size_t)strtol(optarg, (char**)NULL, 10);
+                if ((long)rp->raw_rate < 1) {
+                    fprintf(stderr,
+                            "%s: invalid --rate value: %s\n",
+                            rp->progname, optarg);
+                    exit(1);
+                }
+            } else if (!strcmp(longoptname, "channels")) {
+                rp->raw_channels = (size_t)strtol(optarg, (char**)NULL, 10);
+                if ((long)rp->raw_channels < 1) {
+                    fprintf(stderr,
+                            "%s: invalid --channels value: %s\n",
+                            rp->progname, optarg);
+                    exit(1);
+                }
             } else {
                 fprintf(stderr,
                         "%s: option not implemented: --%s\n",
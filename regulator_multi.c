@@ -0,0 +1,459 @@
+/**
+ * regulator_multi.c --- several clocks, one process
+ *
+ * Copyright (C) 2019 Darren Embry.  GPL2.
+ */
+
+#define REGULATOR_MULTI_C
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include <pulse/pulseaudio.h>
+
+#include "regulator.h"
+#include "regulator_multi.h"
+
+static volatile sig_atomic_t regulator_multi_interrupted = 0;
+
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+static void regulator_multi_sighandler(int signal) {
+    regulator_multi_interrupted = 1;
+}
+
+static void regulator_multi_context_state_cb(pa_context* c, void* userdata) {
+    regulator_multi_t* mp = (regulator_multi_t*)userdata;
+    pa_threaded_mainloop_signal(mp->pa_ml, 0);
+}
+
+static void regulator_multi_stream_state_cb(pa_stream* s, void* userdata) {
+    regulator_multi_stream_t* ms = (regulator_multi_stream_t*)userdata;
+    pa_threaded_mainloop_signal(ms->multi->pa_ml, 0);
+}
+
+/* runs on the mainloop thread; rectifies straight into the ring */
+static void regulator_multi_stream_read_cb(pa_stream* s, size_t nbytes,
+                                           void* userdata) {
+    regulator_multi_stream_t* ms = (regulator_multi_stream_t*)userdata;
+    const void* data;
+    size_t frames;
+    size_t i;
+    size_t pos;
+    int16_t sample;
+
+    if (pa_stream_peek(s, &data, &nbytes) < 0 || !nbytes) {
+        return;
+    }
+    frames = nbytes / ms->r.bytes_per_frame;
+
+    pthread_mutex_lock(&(ms->lock));
+    if (frames > ms->ring_size - ms->ring_count) {
+        ms->overruns += 1;
+        frames = ms->ring_size - ms->ring_count;
+    }
+    pos = (ms->ring_read + ms->ring_count) % ms->ring_size;
+    for (i = 0; i < frames; i += 1) {
+        /* a hole in the stream is silence, so tick indexes stay put */
+        sample = data ? ((const int16_t*)data)[i] : 0;
+        if (sample == INT16_MIN) { /* -32768 => 32767 */
+            sample = INT16_MAX;
+        } else if (sample < 0) {
+            sample = -sample;
+        }
+        ms->ring[pos] = sample;
+        if (++pos == ms->ring_size) {
+            pos = 0;
+        }
+    }
+    ms->ring_count += frames;
+    pthread_cond_signal(&(ms->cond));
+    pthread_mutex_unlock(&(ms->lock));
+
+    pa_stream_drop(s);
+}
+#pragma GCC diagnostic warning "-Wunused-parameter"
+
+static void regulator_multi_stream_open(regulator_multi_t* mp,
+                                        regulator_multi_stream_t* ms,
+                                        char* spec) {
+    regulator_t* parent = mp->parent;
+    regulator_t* rp = &(ms->r);
+    char* colon = strrchr(spec, ':');
+    char* end;
+
+    ms->multi = mp;
+    rp->progname = parent->progname;
+    rp->debug = parent->debug;
+    rp->no_sample_sort_buffer = parent->no_sample_sort_buffer;
+    rp->embedded = 1;
+    rp->ticks_per_hour = parent->ticks_per_hour;
+
+    if (colon) {
+        *colon = '\0';
+        rp->ticks_per_hour = (size_t)strtol(colon + 1, &end, 10);
+        if (*end || rp->ticks_per_hour < 1) {
+            fprintf(stderr, "%s: invalid ticks per hour for %s: %s\n",
+                    parent->progname, spec, colon + 1);
+            exit(1);
+        }
+    }
+    if (!rp->ticks_per_hour) {
+        fprintf(stderr, "%s: %s: --ticks-per-hour is required\n",
+                parent->progname, spec);
+        exit(1);
+    }
+
+    ms->name = strdup(*spec ? spec : "default");
+    ms->device = (*spec && strcmp(spec, "default")) ? strdup(spec) : NULL;
+    if (!ms->name || (*spec && strcmp(spec, "default") && !ms->device)) {
+        perror(parent->progname);
+        exit(1);
+    }
+
+    ms->pa_ss.format   = PA_SAMPLE_S16NE;
+    ms->pa_ss.rate     = 44100;
+    ms->pa_ss.channels = 1;
+
+    if ((3600 * ms->pa_ss.rate) % rp->ticks_per_hour) {
+        fprintf(stderr,
+                "%s: %s: can't process %d ticks per hour, "
+                "sample rate is %d/sec\n",
+                parent->progname, ms->name,
+                (int)rp->ticks_per_hour, ms->pa_ss.rate);
+        exit(1);
+    }
+
+    rp->type = REGULATOR_TYPE_MULTI_STREAM;
+    rp->backend = &regulator_multi_stream_backend;
+    rp->implementation.stream.ms = ms;
+    rp->samples_per_tick      = 3600 * ms->pa_ss.rate / rp->ticks_per_hour;
+    rp->sample_buffer_frames  = rp->samples_per_tick;
+    rp->sample_buffer_samples = rp->sample_buffer_frames * ms->pa_ss.channels;
+    rp->sample_buffer_bytes   = rp->sample_buffer_samples * sizeof(int16_t);
+    rp->bytes_per_frame       = ms->pa_ss.channels * sizeof(int16_t);
+    rp->frames_per_second     = ms->pa_ss.rate;
+
+    /* one fragment per tick: one wakeup per tick per clock */
+    ms->pa_ba.maxlength = (uint32_t)-1;
+    ms->pa_ba.tlength   = (uint32_t)-1;
+    ms->pa_ba.prebuf    = (uint32_t)-1;
+    ms->pa_ba.minreq    = (uint32_t)-1;
+    ms->pa_ba.fragsize  = rp->sample_buffer_bytes;
+
+    ms->ring_size = MULTI_RING_SECONDS * ms->pa_ss.rate;
+    if (!(ms->ring = (int16_t*)malloc(sizeof(int16_t) * ms->ring_size))) {
+        perror(parent->progname);
+        exit(1);
+    }
+    if (!rp->no_sample_sort_buffer) {
+        if (!(rp->sample_sort_buffer =
+              (regulator_sample_t*)
+              malloc(PEAK_SAMPLES * sizeof(regulator_sample_t)))) {
+            perror(parent->progname);
+            exit(1);
+        }
+    }
+    pthread_mutex_init(&(ms->lock), NULL);
+    pthread_cond_init(&(ms->cond), NULL);
+}
+
+static void regulator_multi_stream_connect(regulator_multi_t* mp,
+                                           regulator_multi_stream_t* ms) {
+    pa_stream_state_t state;
+
+    ms->pa_stream = pa_stream_new(mp->pa_ctx, ms->name, &(ms->pa_ss), NULL);
+    if (!ms->pa_stream) {
+        fprintf(stderr, "%s: %s: pa_stream_new() failed: %s\n",
+                mp->parent->progname, ms->name,
+                pa_strerror(pa_context_errno(mp->pa_ctx)));
+        exit(1);
+    }
+    pa_stream_set_state_callback(ms->pa_stream,
+                                 regulator_multi_stream_state_cb, ms);
+    pa_stream_set_read_callback(ms->pa_stream,
+                                regulator_multi_stream_read_cb, ms);
+    if (pa_stream_connect_record(ms->pa_stream, ms->device, &(ms->pa_ba),
+                                 PA_STREAM_ADJUST_LATENCY) < 0) {
+        fprintf(stderr, "%s: %s: pa_stream_connect_record() failed: %s\n",
+                mp->parent->progname, ms->name,
+                pa_strerror(pa_context_errno(mp->pa_ctx)));
+        exit(1);
+    }
+    while ((state = pa_stream_get_state(ms->pa_stream)) != PA_STREAM_READY) {
+        if (!PA_STREAM_IS_GOOD(state)) {
+            fprintf(stderr, "%s: %s: unable to record: %s\n",
+                    mp->parent->progname, ms->name,
+                    pa_strerror(pa_context_errno(mp->pa_ctx)));
+            exit(1);
+        }
+        pa_threaded_mainloop_wait(mp->pa_ml);
+    }
+}
+
+static void* regulator_multi_stream_thread(void* arg) {
+    regulator_multi_stream_t* ms = (regulator_multi_stream_t*)arg;
+    int failed = (regulator_run(&(ms->r)) < 0);
+    pthread_mutex_lock(&(ms->lock));
+    ms->failed = failed;
+    ms->done = 1;
+    pthread_mutex_unlock(&(ms->lock));
+    return NULL;
+}
+
+/* called on the analysis thread, which also owns tick_peak_data */
+size_t regulator_multi_stream_read(struct regulator_t* rp,
+                                   int16_t* buffer, size_t samples) {
+    regulator_multi_stream_t* ms = rp->implementation.stream.ms;
+    float drift = 0;
+    int publish = 0;
+    size_t n;
+    size_t first;
+
+    if (rp->tick_count != ms->status_tick_count &&
+        rp->tick_count % TICKS_PER_GROUP == 0) {
+        drift = regulator_result(rp, MULTI_STATUS_TICKS);
+        publish = 1;
+    }
+
+    pthread_mutex_lock(&(ms->lock));
+    if (publish) {
+        ms->status_drift = drift;
+    }
+    ms->status_tick_count = rp->tick_count;
+    ms->status_good_tick_count = rp->good_tick_count;
+    while (ms->ring_count < samples && !ms->eof) {
+        pthread_cond_wait(&(ms->cond), &(ms->lock));
+    }
+    n = (ms->ring_count < samples) ? ms->ring_count : samples;
+    first = ms->ring_size - ms->ring_read;
+    if (first > n) {
+        first = n;
+    }
+    memcpy(buffer, ms->ring + ms->ring_read, sizeof(int16_t) * first);
+    memcpy(buffer + first, ms->ring, sizeof(int16_t) * (n - first));
+    ms->ring_read = (ms->ring_read + n) % ms->ring_size;
+    ms->ring_count -= n;
+    pthread_mutex_unlock(&(ms->lock));
+
+    return n;
+}
+
+void regulator_multi_stream_close(struct regulator_t* rp) {
+    if (rp->sample_sort_buffer) {
+        free(rp->sample_sort_buffer);
+        rp->sample_sort_buffer = NULL;
+    }
+}
+
+/* frames in the server plus frames waiting in our ring */
+size_t regulator_multi_stream_latency(struct regulator_t* rp) {
+    regulator_multi_stream_t* ms = rp->implementation.stream.ms;
+    pa_usec_t usec = 0;
+    int negative = 0;
+    size_t frames = 0;
+
+    pa_threaded_mainloop_lock(ms->multi->pa_ml);
+    if (ms->pa_stream &&
+        !pa_stream_get_latency(ms->pa_stream, &usec, &negative) && !negative) {
+        frames = (size_t)(usec * ms->pa_ss.rate / PA_USEC_PER_SEC);
+    }
+    pa_threaded_mainloop_unlock(ms->multi->pa_ml);
+
+    pthread_mutex_lock(&(ms->lock));
+    frames += ms->ring_count;
+    pthread_mutex_unlock(&(ms->lock));
+    return frames;
+}
+
+const regulator_backend_t regulator_multi_stream_backend = {
+    .name    = "multi",
+    .open    = NULL,            /* see regulator_multi_stream_open */
+    .read    = regulator_multi_stream_read,
+    .close   = regulator_multi_stream_close,
+    .latency = regulator_multi_stream_latency
+};
+
+static void regulator_multi_show_status(regulator_multi_t* mp, int redraw) {
+    size_t i;
+    if (redraw) {
+        printf("\033[%dA", (int)mp->stream_count);
+    }
+    for (i = 0; i < mp->stream_count; i += 1) {
+        regulator_multi_stream_t* ms = mp->streams + i;
+        pthread_mutex_lock(&(ms->lock));
+        printf("%-32.32s %6d/h %8d ticks %8d good %+10.3f s/day",
+               ms->name, (int)ms->r.ticks_per_hour,
+               (int)ms->status_tick_count, (int)ms->status_good_tick_count,
+               (double)ms->status_drift);
+        if (ms->overruns) {
+            printf(" %d overruns", (int)ms->overruns);
+        }
+        if (ms->done) {
+            printf(" done");
+        }
+        pthread_mutex_unlock(&(ms->lock));
+        printf("\033[K\n");
+    }
+    fflush(stdout);
+}
+
+/**
+ * Analyze one clock per source, all at once.  Each argument is a
+ * PulseAudio source name (or "default"), optionally followed by
+ * ":<ticks-per-hour>".  Capture is event-driven off a single
+ * threaded mainloop; each clock's analysis runs on its own thread,
+ * which sleeps until its ring holds a full read.
+ */
+void regulator_multi_run(struct regulator_t* rp, int argc, char* const argv[]) {
+    regulator_multi_t m = { .parent = rp };
+    regulator_multi_t* mp = &m;
+    pa_context_state_t state;
+    size_t i;
+    int running;
+    int redraw = 0;
+    int tty = isatty(fileno(stdout));
+
+    if (argc < 1) {
+        fprintf(stderr, "%s: multi: at least one source is required\n",
+                rp->progname);
+        exit(1);
+    }
+    /* one WAV file can't hold every source's stream */
+    if (rp->record_filename) {
+        fprintf(stderr, "%s: --record can't be used with multi\n",
+                rp->progname);
+        exit(1);
+    }
+
+    mp->stream_count = argc;
+    mp->streams = (regulator_multi_stream_t*)
+        calloc(mp->stream_count, sizeof(regulator_multi_stream_t));
+    if (!mp->streams) {
+        perror(rp->progname);
+        exit(1);
+    }
+    for (i = 0; i < mp->stream_count; i += 1) {
+        char* spec = strdup(argv[i]);
+        if (!spec) {
+            perror(rp->progname);
+            exit(1);
+        }
+        regulator_multi_stream_open(mp, mp->streams + i, spec);
+        free(spec);
+    }
+
+    if (!(mp->pa_ml = pa_threaded_mainloop_new())) {
+        fprintf(stderr, "%s: pa_threaded_mainloop_new() failed\n",
+                rp->progname);
+        exit(1);
+    }
+    mp->pa_ctx = pa_context_new(pa_threaded_mainloop_get_api(mp->pa_ml),
+                                rp->progname);
+    if (!mp->pa_ctx) {
+        fprintf(stderr, "%s: pa_context_new() failed\n", rp->progname);
+        exit(1);
+    }
+    pa_context_set_state_callback(mp->pa_ctx,
+                                  regulator_multi_context_state_cb, mp);
+    if (pa_context_connect(mp->pa_ctx, NULL, PA_CONTEXT_NOFLAGS, NULL) < 0) {
+        fprintf(stderr, "%s: pa_context_connect() failed: %s\n",
+                rp->progname, pa_strerror(pa_context_errno(mp->pa_ctx)));
+        exit(1);
+    }
+
+    pa_threaded_mainloop_lock(mp->pa_ml);
+    if (pa_threaded_mainloop_start(mp->pa_ml) < 0) {
+        fprintf(stderr, "%s: pa_threaded_mainloop_start() failed\n",
+                rp->progname);
+        exit(1);
+    }
+    while ((state = pa_context_get_state(mp->pa_ctx)) != PA_CONTEXT_READY) {
+        if (!PA_CONTEXT_IS_GOOD(state)) {
+            fprintf(stderr, "%s: unable to connect: %s\n",
+                    rp->progname, pa_strerror(pa_context_errno(mp->pa_ctx)));
+            exit(1);
+        }
+        pa_threaded_mainloop_wait(mp->pa_ml);
+    }
+    for (i = 0; i < mp->stream_count; i += 1) {
+        regulator_multi_stream_connect(mp, mp->streams + i);
+    }
+    pa_threaded_mainloop_unlock(mp->pa_ml);
+
+    signal(SIGINT, regulator_multi_sighandler);
+
+    for (i = 0; i < mp->stream_count; i += 1) {
+        regulator_multi_stream_t* ms = mp->streams + i;
+        if (pthread_create(&(ms->thread), NULL,
+                           regulator_multi_stream_thread, ms)) {
+            perror(rp->progname);
+            exit(1);
+        }
+        ms->thread_started = 1;
+    }
+
+    /* the consolidated live status view */
+    do {
+        sleep(1);
+        running = 0;
+        for (i = 0; i < mp->stream_count; i += 1) {
+            pthread_mutex_lock(&(mp->streams[i].lock));
+            running |= !mp->streams[i].done;
+            pthread_mutex_unlock(&(mp->streams[i].lock));
+        }
+        if (tty || rp->show_stats) {
+            regulator_multi_show_status(mp, redraw && tty);
+            redraw = 1;
+        }
+    } while (running && !regulator_multi_interrupted);
+
+    for (i = 0; i < mp->stream_count; i += 1) {
+        regulator_multi_stream_t* ms = mp->streams + i;
+        pthread_mutex_lock(&(ms->lock));
+        ms->eof = 1;
+        pthread_cond_signal(&(ms->cond));
+        pthread_mutex_unlock(&(ms->lock));
+    }
+    for (i = 0; i < mp->stream_count; i += 1) {
+        if (mp->streams[i].thread_started) {
+            pthread_join(mp->streams[i].thread, NULL);
+        }
+    }
+    signal(SIGINT, SIG_DFL);
+
+    pa_threaded_mainloop_lock(mp->pa_ml);
+    for (i = 0; i < mp->stream_count; i += 1) {
+        regulator_multi_stream_t* ms = mp->streams + i;
+        if (ms->pa_stream) {
+            pa_stream_disconnect(ms->pa_stream);
+            pa_stream_unref(ms->pa_stream);
+            ms->pa_stream = NULL;
+        }
+    }
+    pa_threaded_mainloop_unlock(mp->pa_ml);
+    pa_threaded_mainloop_stop(mp->pa_ml);
+    pa_context_disconnect(mp->pa_ctx);
+    pa_context_unref(mp->pa_ctx);
+    pa_threaded_mainloop_free(mp->pa_ml);
+
+    putchar('\n');
+    for (i = 0; i < mp->stream_count; i += 1) {
+        regulator_multi_stream_t* ms = mp->streams + i;
+        if (ms->failed) {
+            printf("%s: not enough data\n", ms->name);
+        } else {
+            printf("%s: ", ms->name);
+            regulator_show_final_result(&(ms->r));
+        }
+        regulator_cleanup(&(ms->r));
+        pthread_cond_destroy(&(ms->cond));
+        pthread_mutex_destroy(&(ms->lock));
+        free(ms->ring);
+        free(ms->name);
+        free(ms->device);
+    }
+    free(mp->streams);
+}
@@ -0,0 +1,59 @@
+#ifndef REGULATOR_MULTI_H
+#define REGULATOR_MULTI_H
+
+#include <unistd.h>
+#include <pthread.h>
+
+#include "regulator_types.h"
+
+#define MULTI_RING_SECONDS  4
+#define MULTI_STATUS_TICKS  200
+
+typedef struct regulator_multi_stream_t {
+    struct regulator_multi_t* multi;
+    char* device;               /* NULL for the default source */
+    char* name;
+    regulator_t r;
+
+    pa_stream* pa_stream;
+    pa_sample_spec pa_ss;
+    pa_buffer_attr pa_ba;
+
+    /* filled by the mainloop thread, drained by the analysis thread */
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    int16_t* ring;
+    size_t   ring_size;
+    size_t   ring_read;
+    size_t   ring_count;
+    size_t   overruns;
+    int      eof;
+
+    pthread_t thread;
+    int       thread_started;
+    int       done;
+    int       failed;           /* out of data in the first batch */
+
+    /* published by the analysis thread for the status view */
+    size_t status_tick_count;
+    size_t status_good_tick_count;
+    float  status_drift;
+} regulator_multi_stream_t;
+
+typedef struct regulator_multi_t {
+    regulator_t* parent;
+    pa_threaded_mainloop* pa_ml;
+    pa_context* pa_ctx;
+    regulator_multi_stream_t* streams;
+    size_t stream_count;
+} regulator_multi_t;
+
+void regulator_multi_run(struct regulator_t* rp, int argc, char* const argv[]);
+size_t regulator_multi_stream_read(struct regulator_t* rp,
+                                   int16_t* ptr, size_t samples);
+void regulator_multi_stream_close(struct regulator_t* rp);
+size_t regulator_multi_stream_latency(struct regulator_t* rp);
+
+extern const regulator_backend_t regulator_multi_stream_backend;
+
+#endif  /* REGULATOR_MULTI_H */
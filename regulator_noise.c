@@ -0,0 +1,71 @@
+/**
+ * regulator_noise.c --- telling empty tick windows from ticks, cheaply
+ *
+ * Copyright (C) 2019 Darren Embry.  GPL2.
+ */
+
+#define REGULATOR_NOISE_C
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "regulator.h"
+#include "regulator_noise.h"
+
+/* the NOISE_PERCENTILEth block maximum, to the nearest bin below */
+static int16_t regulator_noise_floor(regulator_noise_t* np) {
+    size_t wanted = np->total * NOISE_PERCENTILE / 100;
+    size_t seen = 0;
+    size_t bin;
+    for (bin = 0; bin < NOISE_BINS - 1; bin += 1) {
+        seen += np->bins[bin];
+        if (seen > wanted) {
+            break;
+        }
+    }
+    return (int16_t)(bin << NOISE_BIN_SHIFT);
+}
+
+/**
+ * Called by the peak finding kernel with the block maxima it already
+ * has.  A tick is one or two blocks out of a hundred or more, so the
+ * median block maximum over the last several windows is the room's
+ * noise floor.  A window whose loudest block doesn't clear that by
+ * NOISE_MARGIN holds no tick worth finding; say so and return 1
+ * before any samples are sorted.
+ */
+int regulator_noise_gate(struct regulator_t* rp,
+                         const int16_t* block_maxes, size_t blocks,
+                         int16_t max) {
+    regulator_noise_t* np = &(rp->noise);
+    size_t bin;
+    size_t i;
+    int quiet;
+
+    quiet = (np->windows >= NOISE_WARMUP_WINDOWS &&
+             max < np->floor * NOISE_MARGIN);
+
+    for (i = 0; i < blocks; i += 1) {
+        np->bins[block_maxes[i] >> NOISE_BIN_SHIFT] += 1;
+    }
+    np->total += blocks;
+    np->windows += 1;
+    if (np->total >= NOISE_HALF_LIFE) {
+        np->total = 0;
+        for (bin = 0; bin < NOISE_BINS; bin += 1) {
+            np->bins[bin] /= 2;
+            np->total += np->bins[bin];
+        }
+    }
+    np->floor = regulator_noise_floor(np);
+
+    rp->this_tick_is_quiet = quiet;
+    if (quiet) {
+        rp->this_tick_peak_at_boundary = 0;
+        rp->this_tick_has_well_defined_peak = 0;
+        rp->this_tick_has_early_peak = 0;
+        rp->this_tick_has_late_peak = 0;
+        rp->this_tick_peak = SIZE_MAX;
+    }
+    return quiet;
+}
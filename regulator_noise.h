@@ -0,0 +1,19 @@
+#ifndef REGULATOR_NOISE_H
+#define REGULATOR_NOISE_H
+
+#include <unistd.h>
+#include <stdint.h>
+
+#include "regulator_types.h"
+
+#define NOISE_BIN_SHIFT       7   /* 32768 / NOISE_BINS */
+#define NOISE_PERCENTILE      50
+#define NOISE_MARGIN          2   /* a tick is at least this much louder */
+#define NOISE_WARMUP_WINDOWS  20
+#define NOISE_HALF_LIFE       65536 /* blocks */
+
+int regulator_noise_gate(struct regulator_t* rp,
+                         const int16_t* block_maxes, size_t blocks,
+                         int16_t max);
+
+#endif  /* REGULATOR_NOISE_H */
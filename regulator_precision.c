@@ -0,0 +1,101 @@
+/**
+ * regulator_precision.c --- --precision: stopping once the drift is
+ * known well enough
+ *
+ * Copyright (C) 2019 Darren Embry.  GPL2.
+ */
+
+#define REGULATOR_PRECISION_C
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "regulator.h"
+#include "regulator_fit.h"
+#include "regulator_precision.h"
+
+void regulator_precision_reset(struct regulator_t* rp) {
+    memset(&(rp->precision_sums), 0, sizeof(regulator_precision_t));
+}
+
+/* after regulator_analyze_tick stores a good tick; O(1) */
+void regulator_precision_add(struct regulator_t* rp) {
+    regulator_precision_t* pp = &(rp->precision_sums);
+    const tick_peak_t* point = rp->tick_peak_data + rp->tick_peak_count - 1;
+    double dx = point->index - pp->last_tick;
+    double dy = point->peak - pp->last_peak;
+
+    if (pp->count) {
+        pp->dxx += dx * dx;
+        pp->dxy += dx * dy;
+        pp->dyy += dy * dy;
+    }
+    pp->last_tick = point->index;
+    pp->last_peak = point->peak;
+    ls_fit_add(pp, point->index, point->peak);
+}
+
+/**
+ * Lag-1 autocorrelation of the least-squares residuals, by way of the
+ * Durbin-Watson ratio: a residual less the one before it is the
+ * points' difference less the slope's, so the sum of their squares
+ * comes from the sums of differences, slope or no slope yet.
+ */
+static double regulator_precision_rho(const regulator_precision_t* pp,
+                                      double rss) {
+    double slope = pp->sxy / pp->sxx;
+    double dss = pp->dyy - 2 * slope * pp->dxy + slope * slope * pp->dxx;
+    double rho;
+
+    if (rss <= 0) {
+        return 0;
+    }
+    rho = 1 - dss / rss / 2;
+    return rho < 0 ? 0 : rho > PRECISION_MAX_RHO ? PRECISION_MAX_RHO : rho;
+}
+
+/**
+ * Half the width of a 95% interval on the drift, in seconds per day,
+ * from the standard error of the least-squares slope.  That assumes
+ * independent residuals, but a watch's wander from one tick to the
+ * next (position, amplitude, temperature) is not, and would stop the
+ * run early; so the error is widened for the residuals' lag-1
+ * autocorrelation, as for an AR(1) process.  Negative correlation, a
+ * tick and tock that alternate, is left alone rather than narrowing
+ * it.  Outliers the Kendall-Theil fit shrugs off widen this too, so
+ * it errs long.
+ */
+double regulator_precision_current(struct regulator_t* rp) {
+    regulator_precision_t* pp = &(rp->precision_sums);
+    double rss;
+    double rho;
+    double se;
+
+    if (pp->count < 3 || pp->sxx <= 0) {
+        return INFINITY;
+    }
+    rss = pp->syy - pp->sxy * pp->sxy / pp->sxx;
+    if (rss < 0) {
+        rss = 0;
+    }
+    rho = regulator_precision_rho(pp, rss);
+    se = sqrt(rss / (pp->count - 2) / pp->sxx * (1 + rho) / (1 - rho));
+    if (rp->debug >= 3) {
+        printf("precision: residual autocorrelation %f\n", rho);
+    }
+    return PRECISION_Z * se / rp->frames_per_second * rp->ticks_per_hour * 24;
+}
+
+int regulator_precision_met(struct regulator_t* rp) {
+    double current;
+    if (rp->precision_sums.count < PRECISION_MIN_POINTS) {
+        return 0;
+    }
+    current = regulator_precision_current(rp);
+    if (rp->debug >= 3) {
+        printf("precision: +/-%f seconds per day after %d ticks\n",
+               current, (int)rp->tick_count);
+    }
+    return current <= rp->precision;
+}
@@ -0,0 +1,17 @@
+#ifndef REGULATOR_PRECISION_H
+#define REGULATOR_PRECISION_H
+
+#include <unistd.h>
+
+#include "regulator_types.h"
+
+#define PRECISION_Z          1.96 /* standard errors, for 95% */
+#define PRECISION_MIN_POINTS (TICKS_PER_GROUP * 2)
+#define PRECISION_MAX_RHO    0.99 /* residual autocorrelation */
+
+void regulator_precision_reset(struct regulator_t* rp);
+void regulator_precision_add(struct regulator_t* rp);
+double regulator_precision_current(struct regulator_t* rp);
+int regulator_precision_met(struct regulator_t* rp);
+
+#endif  /* REGULATOR_PRECISION_H */
@@ -8,16 +8,17 @@
 
 #include <stdlib.h>
 #include <stdio.h>
-#include <math.h>
 
 #include <pulse/simple.h>
 #include <pulse/error.h>
 
 #include "regulator.h"
 #include "regulator_pulseaudio.h"
+#include "regulator_record.h"
 
 void regulator_pulseaudio_open(struct regulator_t* rp) {
     rp->type = REGULATOR_TYPE_PULSEAUDIO;
+    rp->backend = &regulator_pulseaudio_backend;
     regulator_pulseaudio_t pulseaudio = {
         .pa_ss = {
             .format   = PA_SAMPLE_S16LE,
@@ -49,19 +50,21 @@ void regulator_pulseaudio_open(struct regulator_t* rp) {
         rp->ticks_per_hour = 3600; /* default */
     }
 
-    if ((3600 * ip->pa_ss.rate) % rp->ticks_per_hour) {
-        fprintf(stderr,
-                "%s: can't process --ticks-per-hour=%d, "
-                "sample rate is %d/sec\n",
-                rp->progname, (int)rp->ticks_per_hour, ip->pa_ss.rate);
-        exit(1);
+    if (!rp->block_ms) {
+        if ((3600 * ip->pa_ss.rate) % rp->ticks_per_hour) {
+            fprintf(stderr,
+                    "%s: can't process --ticks-per-hour=%d, "
+                    "sample rate is %d/sec\n",
+                    rp->progname, (int)rp->ticks_per_hour, ip->pa_ss.rate);
+            exit(1);
+        }
+        rp->samples_per_tick = 3600 * ip->pa_ss.rate / rp->ticks_per_hour;
     }
-    rp->samples_per_tick = 3600 * ip->pa_ss.rate / rp->ticks_per_hour;
 
-    rp->sample_buffer_frames  = rp->samples_per_tick;
+    rp->sample_buffer_frames  = rp->block_ms ?
+        ip->pa_ss.rate * rp->block_ms / 1000 : rp->samples_per_tick;
     rp->sample_buffer_samples = rp->sample_buffer_frames * ip->pa_ss.channels;
-    rp->sample_buffer_bytes   =
-        pa_bytes_per_second(&(ip->pa_ss)) * 3600 / rp->ticks_per_hour;
+    rp->sample_buffer_bytes   = rp->sample_buffer_samples * sizeof(int16_t);
     rp->bytes_per_frame       = ip->pa_ss.channels * sizeof(int16_t);
     rp->frames_per_second     = ip->pa_ss.rate;
 
@@ -71,7 +74,7 @@ void regulator_pulseaudio_open(struct regulator_t* rp) {
     ip->pa_s = pa_simple_new(NULL,             /* server name */
                              rp->progname,     /* name */
                              PA_STREAM_RECORD, /* direction */
-                             NULL,             /* device name or default */
+                             rp->device,       /* device name or default */
                              "record",         /* stream name */
                              &(ip->pa_ss),     /* sample type */
                              NULL,             /* channel map */
@@ -86,15 +89,20 @@ void regulator_pulseaudio_open(struct regulator_t* rp) {
     if (!rp->no_sample_sort_buffer) {
         if (!(rp->sample_sort_buffer =
               (regulator_sample_t*)
-              malloc(rp->sample_buffer_frames * sizeof(regulator_sample_t)))) {
+              malloc(PEAK_SAMPLES * sizeof(regulator_sample_t)))) {
             perror(rp->progname);
             exit(1);
         }
     }
+
+    if (rp->record_filename) {
+        regulator_record_open(rp, ip->pa_ss.channels);
+    }
 }
 
 void regulator_pulseaudio_close(struct regulator_t* rp) {
     regulator_pulseaudio_t *ip = &(rp->implementation.pulseaudio);
+    regulator_record_close(rp);
     if (rp->sample_sort_buffer) {
         free(rp->sample_sort_buffer);
         rp->sample_sort_buffer = NULL;
@@ -111,7 +119,6 @@ size_t regulator_pulseaudio_read(struct regulator_t* rp,
                                  int16_t* buffer, size_t samples) {
     regulator_pulseaudio_t *ip = &(rp->implementation.pulseaudio);
     size_t i;
-    int16_t* samplep;
 
     if (pa_simple_read(ip->pa_s, buffer, samples * rp->bytes_per_frame,
                        &(ip->pa_error)) < 0) {
@@ -136,74 +143,26 @@ size_t regulator_pulseaudio_read(struct regulator_t* rp,
         }
     }
 
-    /* we want the amplitude, not the sign */
-    for (i = 0; i < samples * ip->pa_ss.channels; i += 1) {
-        samplep = buffer + i;
-        if (*samplep == INT16_MIN) { /* -32768 => 32767 */
-            *samplep = INT16_MAX;
-        } else if (*samplep < 0) {
-            *samplep = -*samplep;
-        }
-    }
+    regulator_record_push(rp, buffer, samples);
+
+    regulator_rectify(rp, buffer, samples * ip->pa_ss.channels);
 
     return samples;
 }
 
-void regulator_pulseaudio_test(struct regulator_t* rp) {
-    float seconds = 0.05;
-
-    int save__no_sample_sort_buffer = rp->no_sample_sort_buffer;
-    rp->no_sample_sort_buffer = 1;
-    rp->ticks_per_hour = (size_t)roundf(3600.0 / seconds);
-    if (rp->debug >= 1) {
-        printf("regulator_pulseaudio_test: %d blocks per hour\n", (int)rp->ticks_per_hour);
-    }
-
-    regulator_pulseaudio_open(rp);
-
-    size_t frames = rp->sample_buffer_frames;
-    if (rp->debug >= 1) {
-        printf("regulator_pulseaudio_test: %d frames\n", (int)frames);
-    }
-
-    int16_t* buffer = (int16_t*)malloc(sizeof(int16_t) * frames);
-    if (!buffer) {
-        perror(rp->progname);
-        exit(1);
-    }
-    while (1) {
-        if (regulator_pulseaudio_read(rp, buffer, frames) < frames) {
-            break;
-        }
-        regulator_pulseaudio_vu(rp, buffer, frames);
+size_t regulator_pulseaudio_latency(struct regulator_t* rp) {
+    regulator_pulseaudio_t *ip = &(rp->implementation.pulseaudio);
+    pa_usec_t usec = pa_simple_get_latency(ip->pa_s, &(ip->pa_error));
+    if (usec == (pa_usec_t)-1) {
+        return 0;
     }
-    free(buffer);
-
-    rp->no_sample_sort_buffer = save__no_sample_sort_buffer;
+    return (size_t)(usec * ip->pa_ss.rate / PA_USEC_PER_SEC);
 }
 
-#pragma GCC diagnostic ignored "-Wunused-parameter"
-void regulator_pulseaudio_vu(struct regulator_t* rp, int16_t* buffer, size_t frames) {
-    int16_t max = 0;
-    for (size_t i = 0; i < frames; i += 1) {
-        if (max < buffer[i]) {
-            max = buffer[i];
-        }
-    }
-
-    /* quantize to 6-bit integer (0 to 63) */
-    max = max / (1 << (sizeof(int16_t) * 8 - 7));
-
-    putchar('[');
-    int16_t i;
-    for (i = 0; i <= max; i += 1) {
-        putchar('#');
-    }
-    for (; i < 64; i += 1) {
-        putchar(' ');
-    }
-    putchar(']');
-    putchar('\r');
-    fflush(stdout);
-}
-#pragma GCC diagnostic warning "-Wunused-parameter"
+const regulator_backend_t regulator_pulseaudio_backend = {
+    .name    = "pulseaudio",
+    .open    = regulator_pulseaudio_open,
+    .read    = regulator_pulseaudio_read,
+    .close   = regulator_pulseaudio_close,
+    .latency = regulator_pulseaudio_latency
+};
@@ -9,8 +9,8 @@ void regulator_pulseaudio_open(struct regulator_t* rp);
 void regulator_pulseaudio_close(struct regulator_t* rp);
 size_t regulator_pulseaudio_read(struct regulator_t* rp,
                                  int16_t* ptr, size_t samples);
+size_t regulator_pulseaudio_latency(struct regulator_t* rp);
 
-void regulator_pulseaudio_test(struct regulator_t* rp);
-void regulator_pulseaudio_vu(struct regulator_t* rp, int16_t* buffer, size_t frames);
+extern const regulator_backend_t regulator_pulseaudio_backend;
 
 #endif  /* REGULATOR_PULSEAUDIO_H */
@@ -0,0 +1,230 @@
+/**
+ * regulator_raw.c --- headerless PCM from stdin or a FIFO
+ *
+ * Copyright (C) 2019 Darren Embry.  GPL2.
+ */
+
+#define REGULATOR_RAW_C
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "regulator.h"
+#include "regulator_raw.h"
+#include "regulator_record.h"
+
+regulator_raw_format_t regulator_raw_parse_format(const char* name) {
+    if (!name || !strcmp(name, "s16le") || !strcmp(name, "S16_LE")) {
+        return REGULATOR_RAW_S16LE;
+    }
+    if (!strcmp(name, "s32le") || !strcmp(name, "S32_LE")) {
+        return REGULATOR_RAW_S32LE;
+    }
+    if (!strcmp(name, "f32le") || !strcmp(name, "f32") ||
+        !strcmp(name, "FLOAT_LE")) {
+        return REGULATOR_RAW_F32LE;
+    }
+    return REGULATOR_RAW_NONE;
+}
+
+void regulator_raw_open(struct regulator_t* rp) {
+    rp->type = REGULATOR_TYPE_RAW;
+    rp->backend = &regulator_raw_backend;
+    regulator_raw_t raw = {
+        .fd = 0,
+        .format = rp->raw_format,
+        .rate = rp->raw_rate ? rp->raw_rate : 44100,
+        .channels = rp->raw_channels ? rp->raw_channels : 1
+    };
+    rp->implementation.raw = raw;
+    regulator_raw_t *ip = &(rp->implementation.raw);
+
+    if (rp->filename && strcmp(rp->filename, "-")) {
+        if ((ip->fd = open(rp->filename, O_RDONLY)) < 0) {
+            fprintf(stderr, "%s: unable to open %s: %s\n",
+                    rp->progname, rp->filename, strerror(errno));
+            exit(1);
+        }
+        ip->close_fd = 1;
+    }
+
+#ifdef F_SETPIPE_SZ
+    struct stat st;
+    /* a second of audio in the pipe means one wakeup per read, not
+       one per 64K; failure just leaves the default size */
+    if (!fstat(ip->fd, &st) && S_ISFIFO(st.st_mode)) {
+        fcntl(ip->fd, F_SETPIPE_SZ, (int)(ip->rate * ip->channels * 4));
+    }
+#endif
+
+    if (!rp->block_ms) {
+        if ((3600 * ip->rate) % rp->ticks_per_hour) {
+            fprintf(stderr, "%s: can't process --ticks-per-hour=%d "
+                    "with sample rate %d/sec\n",
+                    rp->progname, (int)rp->ticks_per_hour, (int)ip->rate);
+            exit(1);
+        }
+        rp->samples_per_tick = 3600 * ip->rate / rp->ticks_per_hour;
+    }
+
+    switch (ip->format) {
+    case REGULATOR_RAW_S32LE:
+        ip->bytes_per_sample = sizeof(int32_t);
+        break;
+    case REGULATOR_RAW_F32LE:
+        ip->bytes_per_sample = sizeof(float);
+        break;
+    default:
+        ip->bytes_per_sample = sizeof(int16_t);
+        break;
+    }
+
+    rp->sample_buffer_frames  = rp->block_ms ?
+        ip->rate * rp->block_ms / 1000 : rp->samples_per_tick;
+    rp->sample_buffer_samples = rp->sample_buffer_frames * ip->channels;
+    rp->sample_buffer_bytes   = rp->sample_buffer_samples * ip->bytes_per_sample;
+    rp->bytes_per_frame       = ip->channels * ip->bytes_per_sample;
+    rp->frames_per_second     = ip->rate;
+
+    /* 16-bit little-endian mono goes straight into the analysis
+       buffer; everything else is converted from a staging buffer */
+    ip->direct = (ip->format == REGULATOR_RAW_S16LE && ip->channels == 1 &&
+                  IS_LITTLE_ENDIAN);
+    if (!ip->direct) {
+        if (!(ip->raw_buffer = (char*)malloc(rp->sample_buffer_bytes))) {
+            perror(rp->progname);
+            exit(1);
+        }
+    }
+    if (!rp->no_sample_sort_buffer) {
+        if (!(rp->sample_sort_buffer =
+              (regulator_sample_t*)
+              malloc(PEAK_SAMPLES * sizeof(regulator_sample_t)))) {
+            perror(rp->progname);
+            exit(1);
+        }
+    }
+
+    if (rp->record_filename) {
+        if (ip->format != REGULATOR_RAW_S16LE || !IS_LITTLE_ENDIAN) {
+            fprintf(stderr, "%s: --record needs s16le input\n",
+                    rp->progname);
+            exit(1);
+        }
+        regulator_record_open(rp, ip->channels);
+    }
+}
+
+void regulator_raw_close(struct regulator_t* rp) {
+    regulator_raw_t *ip = &(rp->implementation.raw);
+    regulator_record_close(rp);
+
+    if (rp->sample_sort_buffer) {
+        free(rp->sample_sort_buffer);
+        rp->sample_sort_buffer = NULL;
+    }
+    if (ip->raw_buffer) {
+        free(ip->raw_buffer);
+        ip->raw_buffer = NULL;
+    }
+    if (ip->close_fd) {
+        close(ip->fd);
+    }
+    regulator_raw_t raw = {};
+    rp->implementation.raw = raw;
+}
+
+/* whole frames only; a partial frame at EOF is dropped */
+static size_t regulator_raw_read_frames(struct regulator_t* rp,
+                                        char* dest, size_t frames) {
+    regulator_raw_t *ip = &(rp->implementation.raw);
+    size_t want = frames * rp->bytes_per_frame;
+    size_t got = 0;
+    ssize_t n;
+
+    while (got < want) {
+        n = read(ip->fd, dest + got, want - got);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "%s: read failed: %s\n",
+                    rp->progname, strerror(errno));
+            exit(1);
+        }
+        if (n == 0) {
+            break;
+        }
+        got += n;
+    }
+    return got / rp->bytes_per_frame;
+}
+
+#define CHANNEL_NUMBER 0
+
+size_t regulator_raw_read(struct regulator_t* rp,
+                          int16_t* buffer, size_t samples) {
+    regulator_raw_t *ip = &(rp->implementation.raw);
+    size_t frames;
+    size_t chunk;
+    size_t done = 0;
+    size_t i;
+    int sample;
+
+    if (ip->direct) {
+        frames = regulator_raw_read_frames(rp, (char*)buffer, samples);
+        regulator_record_push(rp, buffer, frames);
+        regulator_rectify(rp, buffer, frames);
+        return frames;
+    }
+
+    while (done < samples) {
+        chunk = samples - done;
+        if (chunk > rp->sample_buffer_frames) {
+            chunk = rp->sample_buffer_frames;
+        }
+        frames = regulator_raw_read_frames(rp, ip->raw_buffer, chunk);
+        regulator_record_push(rp, (const int16_t*)ip->raw_buffer, frames);
+        for (i = 0; i < frames; i += 1) {
+            unsigned char* p = (unsigned char*)ip->raw_buffer +
+                i * rp->bytes_per_frame + CHANNEL_NUMBER * ip->bytes_per_sample;
+            if (ip->format == REGULATOR_RAW_S16LE) {
+                sample = (int16_t)(p[0] | (p[1] << 8));
+            } else if (ip->format == REGULATOR_RAW_S32LE) {
+                /* quantize an int32_t to an int16_t */
+                sample = (int32_t)((uint32_t)p[0] |
+                                   ((uint32_t)p[1] << 8) |
+                                   ((uint32_t)p[2] << 16) |
+                                   ((uint32_t)p[3] << 24)) / (1 << 16);
+            } else {
+                union { uint32_t u; float f; } v;
+                v.u = ((uint32_t)p[0] |
+                       ((uint32_t)p[1] << 8) |
+                       ((uint32_t)p[2] << 16) |
+                       ((uint32_t)p[3] << 24));
+                sample = (v.f >= 1.0f)  ? INT16_MAX :
+                         (v.f <= -1.0f) ? -INT16_MAX :
+                         (int)(v.f * INT16_MAX);
+            }
+            buffer[done + i] = sample;
+        }
+        regulator_rectify(rp, buffer + done, frames);
+        done += frames;
+        if (frames < chunk) {
+            break;
+        }
+    }
+    return done;
+}
+
+const regulator_backend_t regulator_raw_backend = {
+    .name    = "raw",
+    .open    = regulator_raw_open,
+    .read    = regulator_raw_read,
+    .close   = regulator_raw_close,
+    .latency = NULL
+};
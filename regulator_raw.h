@@ -0,0 +1,16 @@
+#ifndef REGULATOR_RAW_H
+#define REGULATOR_RAW_H
+
+#include <unistd.h>
+
+#include "regulator_types.h"
+
+regulator_raw_format_t regulator_raw_parse_format(const char* name);
+void regulator_raw_open(struct regulator_t* rp);
+void regulator_raw_close(struct regulator_t* rp);
+size_t regulator_raw_read(struct regulator_t* rp,
+                          int16_t* ptr, size_t samples);
+
+extern const regulator_backend_t regulator_raw_backend;
+
+#endif  /* REGULATOR_RAW_H */
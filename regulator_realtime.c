@@ -0,0 +1,154 @@
+/**
+ * regulator_realtime.c --- --realtime: nothing allocated, paged in or
+ * waited on once the ticks are coming in
+ *
+ * Copyright (C) 2019 Darren Embry.  GPL2.
+ */
+
+#define REGULATOR_REALTIME_C
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "regulator.h"
+#include "regulator_fit.h"
+#include "regulator_drift.h"
+#include "regulator_realtime.h"
+
+/* stdout's, for good: it's still in use after regulator_realtime_close */
+static char regulator_realtime_stdout[REALTIME_STDOUT];
+
+#ifdef REGULATOR_ALLOC_CHECK
+/**
+ * make ALLOC_CHECK=1: every allocation the analysis thread makes
+ * once it's steady is counted, and regulator_realtime_steady insists
+ * there were none.  glibc's own entry points do the work.
+ */
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+static __thread int regulator_alloc_watched;
+static size_t regulator_alloc_count;
+
+void* malloc(size_t size) {
+    if (regulator_alloc_watched) {
+        __atomic_add_fetch(&regulator_alloc_count, 1, __ATOMIC_RELAXED);
+    }
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    if (regulator_alloc_watched) {
+        __atomic_add_fetch(&regulator_alloc_count, 1, __ATOMIC_RELAXED);
+    }
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    if (regulator_alloc_watched) {
+        __atomic_add_fetch(&regulator_alloc_count, 1, __ATOMIC_RELAXED);
+    }
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+/* so the deepest the analysis goes is already paged in, and locked */
+static void regulator_realtime_touch_stack(void) {
+    volatile char stack[REALTIME_STACK];
+    size_t i;
+    for (i = 0; i < sizeof(stack); i += 4096) {
+        stack[i] = 0;
+    }
+}
+
+/**
+ * After everything else regulator_run opens, so what it allocated is
+ * locked along with the rest.  Whatever the steady state might want
+ * later is allocated now: the slopes for the --stats fits,
+ * --drift-history points for REALTIME_HISTORY_HOURS, and a buffer
+ * for stdout.  Locking memory and SCHED_FIFO need privileges;
+ * without them it's a warning, not an error.
+ */
+void regulator_realtime_open(struct regulator_t* rp) {
+    regulator_realtime_t* tp;
+    struct sched_param param;
+
+    if (!(tp = (regulator_realtime_t*)calloc(1, sizeof(regulator_realtime_t))) ||
+        !(tp->fit_slopes = (float*)malloc(sizeof(float) *
+                                          KT_SLOPES(REALTIME_FIT_TICKS)))) {
+        perror(rp->progname);
+        exit(1);
+    }
+    rp->rt = tp;
+    regulator_drift_reserve(rp, REALTIME_HISTORY_HOURS * 3600);
+
+    fflush(stdout);
+    setvbuf(stdout, regulator_realtime_stdout,
+            isatty(fileno(stdout)) ? _IOLBF : _IOFBF, REALTIME_STDOUT);
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE)) {
+        fprintf(stderr, "%s: --realtime: unable to lock memory: %s\n",
+                rp->progname, strerror(errno));
+    } else {
+        tp->locked = 1;
+    }
+    regulator_realtime_touch_stack();
+
+    if (rp->realtime_priority) {
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = rp->realtime_priority;
+        if ((errno = pthread_setschedparam(pthread_self(), SCHED_FIFO,
+                                           &param))) {
+            fprintf(stderr, "%s: --realtime: unable to use SCHED_FIFO: %s\n",
+                    rp->progname, strerror(errno));
+        }
+    }
+
+    if (rp->debug >= 1) {
+        printf("realtime: memory %slocked, %s\n", tp->locked ? "" : "not ",
+               rp->realtime_priority ? "SCHED_FIFO" : "usual scheduling");
+    }
+}
+
+/* on once the first batch of ticks is in, off once the last one is */
+void regulator_realtime_steady(struct regulator_t* rp, int steady) {
+    if (!rp->rt) {
+        return;
+    }
+    rp->rt->steady = steady;
+#ifdef REGULATOR_ALLOC_CHECK
+    regulator_alloc_watched = steady;
+    if (steady) {
+        __atomic_store_n(&regulator_alloc_count, 0, __ATOMIC_RELAXED);
+        return;
+    }
+    size_t count = __atomic_load_n(&regulator_alloc_count, __ATOMIC_RELAXED);
+    if (rp->debug >= 1) {
+        printf("realtime: %d allocations after warm-up\n", (int)count);
+    }
+    if (count) {
+        fprintf(stderr, "%s: --realtime: %d allocations after warm-up\n",
+                rp->progname, (int)count);
+        abort();
+    }
+#endif
+}
+
+void regulator_realtime_close(struct regulator_t* rp) {
+    regulator_realtime_t* tp = rp->rt;
+    if (!tp) {
+        return;
+    }
+    if (tp->locked) {
+        munlockall();
+    }
+    free(tp->fit_slopes);
+    free(tp);
+    rp->rt = NULL;
+}
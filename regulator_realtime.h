@@ -0,0 +1,23 @@
+#ifndef REGULATOR_REALTIME_H
+#define REGULATOR_REALTIME_H
+
+#include <unistd.h>
+
+#include "regulator_types.h"
+
+#define REALTIME_FIT_TICKS     1000         /* 2 MB of slopes */
+#define REALTIME_HISTORY_HOURS 2
+#define REALTIME_STACK         (256 * 1024) /* touched, so it's resident */
+#define REALTIME_STDOUT        65536
+
+typedef struct regulator_realtime_t {
+    float* fit_slopes;          /* KT_SLOPES(REALTIME_FIT_TICKS) */
+    int    locked;              /* mlockall worked */
+    int    steady;              /* past the first batch of ticks */
+} regulator_realtime_t;
+
+void regulator_realtime_open(struct regulator_t* rp);
+void regulator_realtime_steady(struct regulator_t* rp, int steady);
+void regulator_realtime_close(struct regulator_t* rp);
+
+#endif  /* REGULATOR_REALTIME_H */
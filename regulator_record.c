@@ -0,0 +1,152 @@
+/**
+ * regulator_record.c --- --record: a copy of what was captured, written
+ * on another thread
+ *
+ * Copyright (C) 2019 Darren Embry.  GPL2.
+ */
+
+#define REGULATOR_RECORD_C
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <strings.h>
+
+#include "regulator.h"
+#include "regulator_record.h"
+
+/* FLAC or Ogg Vorbis by extension, WAV otherwise */
+static int regulator_record_format(const char* filename) {
+    const char* dot = strrchr(filename, '.');
+    if (dot && !strcasecmp(dot, ".flac")) {
+        return SF_FORMAT_FLAC | SF_FORMAT_PCM_16;
+    }
+    if (dot && (!strcasecmp(dot, ".ogg") || !strcasecmp(dot, ".oga"))) {
+        return SF_FORMAT_OGG | SF_FORMAT_VORBIS;
+    }
+    return SF_FORMAT_WAV | SF_FORMAT_PCM_16;
+}
+
+static void* regulator_record_thread(void* arg) {
+    regulator_record_t* rec = (regulator_record_t*)arg;
+    regulator_record_slot_t* slot;
+    size_t tail = rec->tail;
+
+    while (1) {
+        if (sem_wait(&(rec->ready)) && errno == EINTR) {
+            continue;
+        }
+        if (tail == __atomic_load_n(&(rec->head), __ATOMIC_ACQUIRE)) {
+            if (__atomic_load_n(&(rec->stop), __ATOMIC_ACQUIRE)) {
+                break;
+            }
+            continue;
+        }
+        slot = rec->slots + tail % RECORD_SLOTS;
+        if (!rec->failed &&
+            sf_writef_short(rec->sf, slot->samples, slot->frames) !=
+            (sf_count_t)slot->frames) {
+            rec->failed = 1;
+        }
+        tail += 1;
+        __atomic_store_n(&(rec->tail), tail, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/* called by a capture backend's open, once it knows its format */
+void regulator_record_open(struct regulator_t* rp, size_t channels) {
+    regulator_record_t* rec;
+    SF_INFO sfinfo = {
+        .samplerate = rp->frames_per_second,
+        .channels   = channels,
+        .format     = regulator_record_format(rp->record_filename)
+    };
+    size_t i;
+
+    if (!(rec = (regulator_record_t*)calloc(1, sizeof(regulator_record_t)))) {
+        perror(rp->progname);
+        exit(1);
+    }
+    rec->channels = channels;
+    for (i = 0; i < RECORD_SLOTS; i += 1) {
+        rec->slots[i].samples = (int16_t*)
+            malloc(sizeof(int16_t) * RECORD_SLOT_FRAMES * channels);
+        if (!rec->slots[i].samples) {
+            perror(rp->progname);
+            exit(1);
+        }
+    }
+    if (!sf_format_check(&sfinfo) ||
+        !(rec->sf = sf_open(rp->record_filename, SFM_WRITE, &sfinfo))) {
+        fprintf(stderr, "%s: unable to write %s: %s\n",
+                rp->progname, rp->record_filename, sf_strerror(NULL));
+        exit(1);
+    }
+    if (sem_init(&(rec->ready), 0, 0) ||
+        pthread_create(&(rec->thread), NULL, regulator_record_thread, rec)) {
+        perror(rp->progname);
+        exit(1);
+    }
+    rp->record = rec;
+}
+
+/**
+ * Called by the capture backend with what it read, before it is
+ * rectified.  Never blocks: a copy, an atomic store, a sem_post.
+ */
+void regulator_record_push(struct regulator_t* rp,
+                           const int16_t* frames, size_t count) {
+    regulator_record_t* rec = rp->record;
+    regulator_record_slot_t* slot;
+    size_t n;
+
+    if (!rec) {
+        return;
+    }
+    while (count) {
+        if (rec->head - __atomic_load_n(&(rec->tail), __ATOMIC_ACQUIRE) ==
+            RECORD_SLOTS) {
+            rec->dropped += count;
+            return;
+        }
+        n = (count < RECORD_SLOT_FRAMES) ? count : RECORD_SLOT_FRAMES;
+        slot = rec->slots + rec->head % RECORD_SLOTS;
+        memcpy(slot->samples, frames, sizeof(int16_t) * n * rec->channels);
+        slot->frames = n;
+        __atomic_store_n(&(rec->head), rec->head + 1, __ATOMIC_RELEASE);
+        sem_post(&(rec->ready));
+        frames += n * rec->channels;
+        count -= n;
+    }
+}
+
+/* whatever is queued is written before the file is closed */
+void regulator_record_close(struct regulator_t* rp) {
+    regulator_record_t* rec = rp->record;
+    size_t i;
+
+    if (!rec) {
+        return;
+    }
+    __atomic_store_n(&(rec->stop), 1, __ATOMIC_RELEASE);
+    sem_post(&(rec->ready));
+    pthread_join(rec->thread, NULL);
+    sem_destroy(&(rec->ready));
+
+    if (rec->failed) {
+        fprintf(stderr, "%s: error writing %s: %s\n",
+                rp->progname, rp->record_filename, sf_strerror(rec->sf));
+    }
+    if (rec->dropped) {
+        fprintf(stderr, "%s: warning: %d frames not recorded; "
+                "disk too slow\n", rp->progname, (int)rec->dropped);
+    }
+    sf_close(rec->sf);
+    for (i = 0; i < RECORD_SLOTS; i += 1) {
+        free(rec->slots[i].samples);
+    }
+    free(rec);
+    rp->record = NULL;
+}
@@ -0,0 +1,44 @@
+#ifndef REGULATOR_RECORD_H
+#define REGULATOR_RECORD_H
+
+#include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sndfile.h>
+
+#include "regulator_types.h"
+
+#define RECORD_SLOTS       64   /* about six seconds at 44100/sec */
+#define RECORD_SLOT_FRAMES 4096
+
+typedef struct regulator_record_slot_t {
+    int16_t* samples;
+    size_t   frames;
+} regulator_record_slot_t;
+
+/**
+ * A single-producer, single-consumer ring of preallocated slots.
+ * Only the capture thread moves head and only the writer moves
+ * tail, so neither ever waits on the other; when the ring is full
+ * the capture thread drops the audio instead.
+ */
+typedef struct regulator_record_t {
+    SNDFILE* sf;
+    size_t   channels;
+    regulator_record_slot_t slots[RECORD_SLOTS];
+    size_t   head;
+    size_t   tail;
+    size_t   dropped;           /* frames */
+    int      stop;
+    int      failed;
+    sem_t    ready;             /* one post per slot, and one to stop */
+    pthread_t thread;
+} regulator_record_t;
+
+void regulator_record_open(struct regulator_t* rp, size_t channels);
+void regulator_record_push(struct regulator_t* rp,
+                           const int16_t* frames, size_t count);
+void regulator_record_close(struct regulator_t* rp);
+
+#endif  /* REGULATOR_RECORD_H */
@@ -12,9 +12,13 @@
 
 #include "regulator.h"
 #include "regulator_sndfile.h"
+#include "regulator_cache.h"
+#include "regulator_decode.h"
+#include "regulator_filter.h"
 
 void regulator_sndfile_open(struct regulator_t* rp) {
     rp->type = REGULATOR_TYPE_SNDFILE;
+    rp->backend = &regulator_sndfile_backend;
     regulator_sndfile_t sndfile = {
         .sfinfo = {
             .format = 0
@@ -31,37 +35,85 @@ void regulator_sndfile_open(struct regulator_t* rp) {
         exit(1);
     }
 
-    if ((3600 * ip->sfinfo.samplerate) % rp->ticks_per_hour) {
-        fprintf(stderr, "%s: can't process --ticks-per-hour=%d "
-                "with sample rate %d/sec\n",
-                rp->progname, (int)rp->ticks_per_hour, ip->sfinfo.samplerate);
-        exit(1);
+    if (!rp->block_ms) {
+        if ((3600 * ip->sfinfo.samplerate) % rp->ticks_per_hour) {
+            fprintf(stderr, "%s: can't process --ticks-per-hour=%d "
+                    "with sample rate %d/sec\n",
+                    rp->progname, (int)rp->ticks_per_hour,
+                    ip->sfinfo.samplerate);
+            exit(1);
+        }
+        rp->samples_per_tick =
+            3600 * ip->sfinfo.samplerate / rp->ticks_per_hour;
     }
-    rp->samples_per_tick = 3600 * ip->sfinfo.samplerate / rp->ticks_per_hour;
 
-    rp->sample_buffer_frames  = rp->samples_per_tick;
+    rp->sample_buffer_frames  = rp->block_ms ?
+        ip->sfinfo.samplerate * rp->block_ms / 1000 : rp->samples_per_tick;
     rp->sample_buffer_samples = rp->sample_buffer_frames * ip->sfinfo.channels;
     rp->sample_buffer_bytes   = rp->sample_buffer_samples * sizeof(int);
     rp->bytes_per_frame       = ip->sfinfo.channels * sizeof(int);
     rp->frames_per_second     = ip->sfinfo.samplerate;
 
-    if (!(ip->sf_sample_buffer = (int*)malloc(rp->sample_buffer_bytes))) {
+    if (!(ip->sf_sample_buffer =
+          (int*)malloc(SNDFILE_BLOCK_FRAMES * rp->bytes_per_frame))) {
         perror(rp->progname);
         exit(1);
     }
     if (!rp->no_sample_sort_buffer) {
         if (!(rp->sample_sort_buffer =
               (regulator_sample_t*)
-              malloc(rp->sample_buffer_frames * sizeof(regulator_sample_t)))) {
+              malloc(PEAK_SAMPLES * sizeof(regulator_sample_t)))) {
             perror(rp->progname);
             exit(1);
         }
     }
+
+    /* started on the first read, so a cache hit never starts it; the
+       filter runs through the samples in order, so not with one */
+    ip->decode_threads = regulator_decode_threads(rp);
+    if (ip->decode_threads < 2 || regulator_filter_enabled(rp)) {
+        ip->decode_threads = 0;
+    }
+
+    if (rp->cache) {
+        regulator_cache_open(rp);
+    }
+}
+
+/* for --sparse, which reads a little here and there, on this thread */
+void regulator_sndfile_seek(struct regulator_t* rp, size_t frame) {
+    regulator_sndfile_t *ip = &(rp->implementation.sndfile);
+
+    regulator_decode_close(rp);
+    ip->decode_threads = 0;
+    if (ip->cache_samples) {
+        ip->cache_pos = (frame < ip->cache_frames) ? frame : ip->cache_frames;
+        return;
+    }
+    rp->filter.rate = 0;        /* no ringing from where it was before */
+    if (sf_seek(ip->sf, (sf_count_t)frame, SEEK_SET) < 0) {
+        fprintf(stderr, "%s: unable to seek in %s: %s\n",
+                rp->progname, rp->filename, sf_strerror(ip->sf));
+        exit(1);
+    }
+}
+
+/* back to the first frame, decoding on this thread again if need be */
+void regulator_sndfile_rewind(struct regulator_t* rp) {
+    regulator_sndfile_t *ip = &(rp->implementation.sndfile);
+    size_t threads = ip->decode_threads;
+
+    regulator_decode_close(rp);
+    ip->decode_threads = threads;
+    sf_seek(ip->sf, 0, SEEK_SET);
+    rp->filter.rate = 0;        /* start the filter over, too */
 }
 
 void regulator_sndfile_close(struct regulator_t* rp) {
     regulator_sndfile_t *ip = &(rp->implementation.sndfile);
 
+    regulator_cache_close(rp);
+    regulator_decode_close(rp);
     if (rp->sample_sort_buffer) {
         free(rp->sample_sort_buffer);
         rp->sample_sort_buffer = NULL;
@@ -79,27 +131,57 @@ void regulator_sndfile_close(struct regulator_t* rp) {
 
 #define CHANNEL_NUMBER 0
 
+/* channel 0 of frames read by sf_readf_int, quantized, still signed */
+void regulator_sndfile_quantize(const int* frames, int channels,
+                                int16_t* buffer, size_t count) {
+    size_t i;
+    for (i = 0; i < count; i += 1) {
+        /* quantize an int to an int16_t */
+        buffer[i] = frames[i * channels + CHANNEL_NUMBER] /
+            (1 << ((sizeof(int) - sizeof(int16_t)) * 8));
+    }
+}
+
 size_t regulator_sndfile_read(struct regulator_t* rp,
                               int16_t* buffer, size_t samples) {
     regulator_sndfile_t *ip = &(rp->implementation.sndfile);
     sf_count_t sf_frames;
-    sf_count_t i;
-    int sample;                 /* int, as read from sf_readf_int */
-    if ((sf_frames = sf_readf_int(ip->sf, ip->sf_sample_buffer,
-                                  samples)) <= 0) {
-        return 0;
+    size_t done = 0;
+    size_t want;
+    if (ip->cache_samples) {
+        return regulator_cache_read(rp, buffer, samples);
     }
-    for (i = 0; i < sf_frames; i += 1) {
-        /* quantize an int to an int16_t */
-        sample =
-            ip->sf_sample_buffer[i * ip->sfinfo.channels + CHANNEL_NUMBER] /
-            (1 << ((sizeof(int) - sizeof(int16_t)) * 8));
-        if (sample == INT16_MIN) { /* -32768 => 32767 */
-            sample = INT16_MAX;
-        } else if (sample < 0) {
-            sample = -sample;
+    if (ip->decode_threads) {
+        if (!ip->decode) {
+            regulator_decode_open(rp);
         }
-        buffer[i] = sample;
+        return regulator_decode_read(rp, buffer, samples);
     }
-    return sf_frames;
+    /* each block is converted while it's still in cache */
+    while (done < samples) {
+        want = samples - done;
+        if (want > SNDFILE_BLOCK_FRAMES) {
+            want = SNDFILE_BLOCK_FRAMES;
+        }
+        if ((sf_frames = sf_readf_int(ip->sf, ip->sf_sample_buffer,
+                                      want)) <= 0) {
+            break;
+        }
+        regulator_sndfile_quantize(ip->sf_sample_buffer, ip->sfinfo.channels,
+                                   buffer + done, sf_frames);
+        regulator_rectify(rp, buffer + done, sf_frames);
+        done += sf_frames;
+        if ((size_t)sf_frames < want) {
+            break;
+        }
+    }
+    return done;
 }
+
+const regulator_backend_t regulator_sndfile_backend = {
+    .name    = "sndfile",
+    .open    = regulator_sndfile_open,
+    .read    = regulator_sndfile_read,
+    .close   = regulator_sndfile_close,
+    .latency = NULL
+};
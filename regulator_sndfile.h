@@ -5,9 +5,18 @@
 
 #include "regulator_types.h"
 
+/* decoded a block at a time, so the ints never leave L1 */
+#define SNDFILE_BLOCK_FRAMES 1024
+
 void regulator_sndfile_open(struct regulator_t* rp);
 void regulator_sndfile_close(struct regulator_t* rp);
 size_t regulator_sndfile_read(struct regulator_t* rp,
                               int16_t* ptr, size_t samples);
+void regulator_sndfile_rewind(struct regulator_t* rp);
+void regulator_sndfile_seek(struct regulator_t* rp, size_t frame);
+void regulator_sndfile_quantize(const int* frames, int channels,
+                                int16_t* buffer, size_t count);
+
+extern const regulator_backend_t regulator_sndfile_backend;
 
 #endif  /* REGULATOR_SNDFILE_H */
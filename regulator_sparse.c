@@ -0,0 +1,268 @@
+/**
+ * regulator_sparse.c --- --sparse: a window of ticks every so often,
+ * for triage of long recordings
+ *
+ * Copyright (C) 2019 Darren Embry.  GPL2.
+ */
+
+#define REGULATOR_SPARSE_C
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "regulator.h"
+#include "regulator_sndfile.h"
+#include "regulator_fit.h"
+#include "regulator_lib.h"
+#include "regulator_sparse.h"
+
+/**
+ * A window's line through its own points: the slope libregulator
+ * found, and the median peak once that slope is taken out, at the
+ * window's mean tick index.
+ */
+static void regulator_sparse_center(struct regulator_t* rp,
+                                    regulator_sparse_window_t* wp,
+                                    float* scratch) {
+    const tick_peak_t* points = rp->tick_peak_data + wp->first;
+    double sum = 0;
+    size_t i;
+
+    for (i = 0; i < wp->count; i += 1) {
+        sum += points[i].index;
+    }
+    wp->center = sum / wp->count;
+    for (i = 0; i < wp->count; i += 1) {
+        scratch[i] = points[i].peak -
+            wp->slope * (points[i].index - wp->center);
+    }
+    qsort(scratch, wp->count, sizeof(float), (qsort_function)float_sort);
+    wp->center_peak = scratch[wp->count / 2];
+}
+
+/**
+ * Each window's peaks are relative to its own tick numbering, which
+ * is the file's from where the window starts; a clock running fast
+ * or slow slips whole ticks between windows.  Renumber this window's
+ * ticks by however many whole ticks put its line nearest where the
+ * previous window's line says it should be.  A slip back can number
+ * the first few the same as the previous window's last few, or
+ * lower, when the windows are back to back; those are dropped, so no
+ * tick index is fit twice.
+ */
+static void regulator_sparse_align(struct regulator_t* rp,
+                                   const regulator_sparse_window_t* prev,
+                                   regulator_sparse_window_t* wp) {
+    tick_peak_t* points = rp->tick_peak_data + wp->first;
+    float slope = (prev->slope + wp->slope) / 2;
+    float predicted =
+        prev->center_peak + slope * (wp->center - prev->center);
+    long slip = lroundf((predicted - wp->center_peak) /
+                        rp->samples_per_tick);
+    size_t drop = 0;
+    size_t i;
+
+    if (!slip) {
+        return;
+    }
+    if (rp->debug >= 2) {
+        printf("sparse: renumbering window at tick %d by %ld ticks\n",
+               (int)wp->start_tick, -slip);
+    }
+    for (i = 0; i < wp->count; i += 1) {
+        points[i].index -= slip;
+        points[i].peak += slip * (ssize_t)rp->samples_per_tick;
+    }
+    wp->center -= slip;
+    wp->center_peak += slip * (float)rp->samples_per_tick;
+
+    if (wp->first) {
+        while (drop < wp->count && points[drop].index <= points[-1].index) {
+            drop += 1;
+        }
+    }
+    if (drop) {
+        if (rp->debug >= 2) {
+            printf("sparse: dropping %d ticks already seen\n", (int)drop);
+        }
+        memmove(points, points + drop,
+                sizeof(tick_peak_t) * (wp->count - drop));
+        wp->count -= drop;
+        rp->tick_peak_count -= drop;
+    }
+}
+
+/**
+ * One window through its own libregulator context.  *result is
+ * filled in even if the window fails, so its rejected ticks are
+ * counted; it's left alone only if there's no context to ask.
+ */
+static int regulator_sparse_window(struct regulator_t* rp,
+                                   regulator_sparse_window_t* wp,
+                                   size_t window_ticks, int16_t* buffer,
+                                   regulator_lib_peak_t* peaks,
+                                   regulator_lib_result_t* result) {
+    regulator_lib_t* lp;
+    size_t frames;
+    size_t tick;
+    size_t i;
+    int status;
+    int fitted;
+
+    if ((status = regulator_lib_new(&lp, rp->frames_per_second,
+                                    rp->ticks_per_hour))) {
+        return status;
+    }
+    regulator_sndfile_seek(rp, wp->start_tick * rp->samples_per_tick);
+    for (tick = 0; tick < window_ticks; tick += 1) {
+        frames = regulator_sndfile_read(rp, buffer, rp->samples_per_tick);
+        /* already rectified, which rectifying again won't change */
+        if ((status = regulator_lib_feed(lp, buffer, frames, 1)) ||
+            frames < rp->samples_per_tick) {
+            break;
+        }
+    }
+    fitted = regulator_lib_fit(lp, result);
+    if (!status) {
+        status = fitted;
+    }
+    if (!status) {
+        wp->first = rp->tick_peak_count;
+        wp->count = regulator_lib_peaks(lp, peaks, window_ticks);
+        wp->slope = -result->drift * rp->frames_per_second /
+            rp->ticks_per_hour / 24;
+        for (i = 0; i < wp->count; i += 1) {
+            rp->tick_peak_data[wp->first + i].index =
+                wp->start_tick + peaks[i].tick;
+            rp->tick_peak_data[wp->first + i].peak = peaks[i].peak;
+        }
+        rp->tick_peak_count += wp->count;
+    }
+    regulator_lib_free(lp);
+    return status;
+}
+
+/**
+ * --sparse: seek to a window of rp->sparse_window seconds every
+ * rp->sparse_interval seconds and read only those.  The windows'
+ * ticks are put on one numbering and fit together, at most an
+ * hour's worth of ticks as without --sparse.
+ */
+void regulator_sparse_run(struct regulator_t* rp) {
+    regulator_sndfile_t *ip;
+    regulator_sparse_window_t* windows;
+    regulator_sparse_window_t* prev = NULL;
+    regulator_lib_result_t result;
+    regulator_lib_peak_t* peaks;
+    int16_t* buffer;
+    float* scratch;
+    size_t total_ticks;
+    size_t window_ticks;
+    size_t interval_ticks;
+    size_t count;
+    size_t seconds;
+    size_t k;
+    int status;
+
+    if (!rp->filename || !strcmp(rp->filename, "-") || rp->raw_format) {
+        fprintf(stderr, "%s: --sparse needs a sound file\n", rp->progname);
+        exit(1);
+    }
+    regulator_sndfile_open(rp);
+    ip = &(rp->implementation.sndfile);
+    if (!ip->cache_samples && !ip->sfinfo.seekable) {
+        fprintf(stderr, "%s: --sparse: %s is not seekable\n",
+                rp->progname, rp->filename);
+        exit(1);
+    }
+
+    total_ticks = (ip->cache_samples ? ip->cache_frames :
+                   (size_t)ip->sfinfo.frames) / rp->samples_per_tick;
+    window_ticks = rp->sparse_window * rp->ticks_per_hour / 3600;
+    interval_ticks = rp->sparse_interval * rp->ticks_per_hour / 3600;
+    if (window_ticks > total_ticks) {
+        window_ticks = total_ticks;
+    }
+    /* before dividing by the interval, which is at least this */
+    if (window_ticks < TICKS_PER_GROUP * 2) {
+        fprintf(stderr, "%s: --sparse: too few ticks per window; "
+                "need %d, try a longer window\n", rp->progname,
+                TICKS_PER_GROUP * 2);
+        exit(1);
+    }
+    if (interval_ticks < window_ticks) {
+        interval_ticks = window_ticks;
+    }
+    count = (total_ticks - window_ticks) / interval_ticks + 1;
+    if (count * window_ticks > rp->ticks_per_hour) {
+        window_ticks = rp->ticks_per_hour / count;
+    }
+    if (window_ticks < TICKS_PER_GROUP * 2) {
+        fprintf(stderr, "%s: --sparse: too few ticks per window; "
+                "try a longer interval\n", rp->progname);
+        exit(1);
+    }
+    if (rp->debug >= 1) {
+        printf("sparse: %d windows of %d ticks, every %d ticks\n",
+               (int)count, (int)window_ticks, (int)interval_ticks);
+    }
+
+    windows = (regulator_sparse_window_t*)
+        calloc(count, sizeof(regulator_sparse_window_t));
+    rp->tick_peak_data =
+        (tick_peak_t*)malloc(sizeof(tick_peak_t) * count * window_ticks);
+    peaks = (regulator_lib_peak_t*)
+        malloc(sizeof(regulator_lib_peak_t) * window_ticks);
+    buffer = (int16_t*)malloc(sizeof(int16_t) * rp->samples_per_tick);
+    scratch = (float*)malloc(sizeof(float) * window_ticks);
+    if (!windows || !rp->tick_peak_data || !peaks || !buffer || !scratch) {
+        perror(rp->progname);
+        exit(1);
+    }
+    rp->tick_peak_count = 0;
+
+    for (k = 0; k < count; k += 1) {
+        regulator_sparse_window_t* wp = windows + k;
+        wp->start_tick = k * interval_ticks;
+        seconds = wp->start_tick * rp->samples_per_tick / rp->frames_per_second;
+        printf("%3d:%02d:%02d: ", (int)(seconds / 3600),
+               (int)(seconds / 60 % 60), (int)(seconds % 60));
+
+        memset(&result, 0, sizeof(result));
+        status = regulator_sparse_window(rp, wp, window_ticks, buffer,
+                                         peaks, &result);
+        rp->tick_count += result.ticks;
+        rp->quiet_tick_count += result.quiet_ticks;
+        rp->boundary_peak_count += result.boundary_ticks;
+        rp->ill_defined_tick_count += result.ill_defined_ticks;
+        if (status) {
+            /* none of a failed window's points were kept */
+            rp->ill_defined_tick_count += result.good_ticks;
+            printf("%s\n", regulator_lib_strerror(status));
+            continue;
+        }
+        rp->good_tick_count += result.good_ticks;
+        printf("%f seconds %s (%d ticks)\n",
+               fabs(result.drift), (result.drift < 0 ? "slow" : "fast"),
+               (int)wp->count);
+
+        regulator_sparse_center(rp, wp, scratch);
+        if (prev) {
+            regulator_sparse_align(rp, prev, wp);
+        }
+        prev = wp;
+    }
+
+    if (!rp->tick_peak_count) {
+        fprintf(stderr, "%s: not enough data\n", rp->progname);
+        exit(1);
+    }
+    regulator_show_final_result(rp);
+
+    free(scratch);
+    free(buffer);
+    free(peaks);
+    free(windows);
+}
@@ -0,0 +1,23 @@
+#ifndef REGULATOR_SPARSE_H
+#define REGULATOR_SPARSE_H
+
+#include <unistd.h>
+
+#include "regulator_types.h"
+
+#define SPARSE_DEFAULT_WINDOW   60  /* seconds */
+#define SPARSE_DEFAULT_INTERVAL 600 /* seconds, start to start */
+
+/* one stretch of the recording, analyzed on its own */
+typedef struct regulator_sparse_window_t {
+    size_t start_tick;
+    size_t first;               /* its points in tick_peak_data */
+    size_t count;
+    float  slope;               /* samples per tick */
+    float  center;              /* tick index */
+    float  center_peak;         /* the fitted peak there */
+} regulator_sparse_window_t;
+
+void regulator_sparse_run(struct regulator_t* rp);
+
+#endif  /* REGULATOR_SPARSE_H */
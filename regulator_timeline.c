@@ -0,0 +1,224 @@
+/**
+ * regulator_timeline.c --- per-tick results on disk, and replaying them
+ *
+ * Copyright (C) 2019 Darren Embry.  GPL2.
+ */
+
+#define REGULATOR_TIMELINE_C
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "regulator.h"
+#include "regulator_timeline.h"
+
+void regulator_timeline_open(struct regulator_t* rp) {
+    regulator_timeline_header_t header = {
+        .magic             = TIMELINE_MAGIC,
+        .version           = TIMELINE_VERSION,
+        .byte_order        = TIMELINE_BYTE_ORDER,
+        .header_size       = sizeof(regulator_timeline_header_t),
+        .record_size       = sizeof(regulator_timeline_record_t),
+        .samples_per_tick  = rp->samples_per_tick,
+        .frames_per_second = rp->frames_per_second,
+        .ticks_per_hour    = rp->ticks_per_hour
+    };
+    if (!(rp->timeline = fopen(rp->timeline_filename, "wb"))) {
+        fprintf(stderr, "%s: unable to write %s: %s\n",
+                rp->progname, rp->timeline_filename, strerror(errno));
+        exit(1);
+    }
+    if (fwrite(&header, sizeof(header), 1, rp->timeline) != 1) {
+        perror(rp->progname);
+        exit(1);
+    }
+}
+
+/* after regulator_analyze_tick has judged the tick */
+void regulator_timeline_append(struct regulator_t* rp) {
+    regulator_timeline_record_t record = {
+        .tick   = rp->tick_count,
+        .peak   = UINT32_MAX,
+        .flags  = 0,
+        .offset = (int32_t)rp->peak_offset
+    };
+    if (rp->this_tick_has_well_defined_peak) {
+        record.peak = rp->this_tick_peak;
+        record.flags |= TIMELINE_WELL_DEFINED;
+        if (rp->this_tick_has_early_peak) {
+            record.flags |= TIMELINE_EARLY;
+        }
+        if (rp->this_tick_has_late_peak) {
+            record.flags |= TIMELINE_LATE;
+        }
+    }
+    if (rp->this_tick_is_quiet) {
+        record.flags |= TIMELINE_QUIET;
+    }
+    if (rp->this_tick_peak_at_boundary) {
+        record.flags |= TIMELINE_BOUNDARY;
+    } else if (rp->this_tick_has_well_defined_peak) {
+        /* peak - offset went into tick_peak_data */
+        record.flags |= TIMELINE_GOOD;
+    }
+    if (fwrite(&record, sizeof(record), 1, rp->timeline) != 1) {
+        perror(rp->progname);
+        exit(1);
+    }
+}
+
+/* the first batch of ticks is being analyzed over again */
+void regulator_timeline_rewind(struct regulator_t* rp) {
+    if (fflush(rp->timeline) ||
+        ftruncate(fileno(rp->timeline), sizeof(regulator_timeline_header_t)) ||
+        fseek(rp->timeline, sizeof(regulator_timeline_header_t), SEEK_SET)) {
+        perror(rp->progname);
+        exit(1);
+    }
+}
+
+void regulator_timeline_close(struct regulator_t* rp) {
+    if (rp->timeline) {
+        if (fclose(rp->timeline)) {
+            perror(rp->progname);
+        }
+        rp->timeline = NULL;
+    }
+}
+
+static void regulator_timeline_show_range(struct regulator_t* rp,
+                                          const regulator_timeline_record_t* records,
+                                          size_t count,
+                                          size_t first, size_t last) {
+    regulator_t r = {
+        .progname          = rp->progname,
+        .debug             = rp->debug,
+        .frames_per_second = rp->frames_per_second,
+        .ticks_per_hour    = rp->ticks_per_hour,
+        .confidence        = rp->confidence
+    };
+    size_t i;
+
+    r.tick_peak_data = (tick_peak_t*)malloc(sizeof(tick_peak_t) * (count + 1));
+    if (!r.tick_peak_data) {
+        perror(rp->progname);
+        exit(1);
+    }
+    for (i = 0; i < count; i += 1) {
+        if (records[i].tick < first || records[i].tick > last) {
+            continue;
+        }
+        r.tick_count += 1;
+        if (records[i].flags & TIMELINE_GOOD) {
+            r.tick_peak_data[r.tick_peak_count].index = records[i].tick;
+            r.tick_peak_data[r.tick_peak_count].peak =
+                (ssize_t)records[i].peak - records[i].offset;
+            r.tick_peak_count += 1;
+            r.good_tick_count += 1;
+        } else if (records[i].flags & TIMELINE_BOUNDARY) {
+            r.boundary_peak_count += 1;
+        } else if (records[i].flags & TIMELINE_QUIET) {
+            r.quiet_tick_count += 1;
+        } else {
+            r.ill_defined_tick_count += 1;
+        }
+    }
+
+    if (last == SIZE_MAX) {
+        printf("ticks %d-: ", (int)first);
+    } else {
+        printf("ticks %d-%d: ", (int)first, (int)last);
+    }
+    regulator_show_final_result(&r);
+    free(r.tick_peak_data);
+}
+
+/**
+ * "regulator replay <file> [<first>-[<last>] ...]": re-fit a saved
+ * --timeline over each range of tick numbers, or over all of it.
+ */
+void regulator_timeline_replay(struct regulator_t* rp,
+                               int argc, char* const argv[]) {
+    const regulator_timeline_header_t* header;
+    const regulator_timeline_record_t* records;
+    struct stat st;
+    size_t count;
+    void* map;
+    int fd;
+    int i;
+
+    if (argc < 1) {
+        fprintf(stderr, "%s: replay: timeline file required\n", rp->progname);
+        exit(1);
+    }
+    if ((fd = open(argv[0], O_RDONLY)) < 0 || fstat(fd, &st)) {
+        fprintf(stderr, "%s: unable to open %s: %s\n",
+                rp->progname, argv[0], strerror(errno));
+        exit(1);
+    }
+    if ((size_t)st.st_size < sizeof(regulator_timeline_header_t)) {
+        fprintf(stderr, "%s: %s: not a timeline file\n",
+                rp->progname, argv[0]);
+        exit(1);
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        perror(rp->progname);
+        exit(1);
+    }
+    close(fd);
+
+    header = (const regulator_timeline_header_t*)map;
+    if (memcmp(header->magic, TIMELINE_MAGIC, sizeof(header->magic))) {
+        fprintf(stderr, "%s: %s: not a timeline file\n",
+                rp->progname, argv[0]);
+        exit(1);
+    }
+    if (header->version != TIMELINE_VERSION ||
+        header->byte_order != TIMELINE_BYTE_ORDER ||
+        header->record_size != sizeof(regulator_timeline_record_t) ||
+        header->header_size > (size_t)st.st_size) {
+        fprintf(stderr, "%s: %s: unsupported timeline version or byte order\n",
+                rp->progname, argv[0]);
+        exit(1);
+    }
+    records = (const regulator_timeline_record_t*)
+        ((const char*)map + header->header_size);
+    count = (st.st_size - header->header_size) / header->record_size;
+
+    rp->frames_per_second = header->frames_per_second;
+    rp->ticks_per_hour    = header->ticks_per_hour;
+    rp->samples_per_tick  = header->samples_per_tick;
+    if (rp->debug >= 1) {
+        printf("%d ticks per hour, %d samples per tick, %d records\n",
+               (int)rp->ticks_per_hour, (int)rp->samples_per_tick,
+               (int)count);
+    }
+
+    if (argc < 2) {
+        regulator_timeline_show_range(rp, records, count, 0, SIZE_MAX);
+    }
+    for (i = 1; i < argc; i += 1) {
+        char* end;
+        size_t first = (size_t)strtoul(argv[i], &end, 10);
+        size_t last = SIZE_MAX;
+        if (*end == '-' && *(end + 1)) {
+            last = (size_t)strtoul(end + 1, &end, 10);
+        } else if (*end == '-') {
+            end += 1;
+        }
+        if (*end || last < first) {
+            fprintf(stderr, "%s: invalid tick range: %s\n",
+                    rp->progname, argv[i]);
+            exit(1);
+        }
+        regulator_timeline_show_range(rp, records, count, first, last);
+    }
+
+    munmap(map, st.st_size);
+}
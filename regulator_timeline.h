@@ -0,0 +1,15 @@
+#ifndef REGULATOR_TIMELINE_H
+#define REGULATOR_TIMELINE_H
+
+#include <unistd.h>
+
+#include "regulator_types.h"
+
+void regulator_timeline_open(struct regulator_t* rp);
+void regulator_timeline_append(struct regulator_t* rp);
+void regulator_timeline_rewind(struct regulator_t* rp);
+void regulator_timeline_close(struct regulator_t* rp);
+void regulator_timeline_replay(struct regulator_t* rp,
+                               int argc, char* const argv[]);
+
+#endif  /* REGULATOR_TIMELINE_H */
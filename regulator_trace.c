@@ -0,0 +1,178 @@
+/**
+ * regulator_trace.c --- the timegrapher's paper strip, drawn as we go
+ *
+ * Copyright (C) 2019 Darren Embry.  GPL2.
+ */
+
+#define REGULATOR_TRACE_C
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+
+#include "regulator.h"
+#include "regulator_trace.h"
+
+static void regulator_trace_clear(struct regulator_t* rp) {
+    regulator_trace_t* tp = rp->trace;
+    memset(tp->raster, 255, sizeof(tp->raster));
+    tp->rows = 1;
+    tp->row_ticks = 0;
+    tp->next_export = TRACE_EXPORT_SECONDS * rp->ticks_per_hour / 3600;
+}
+
+void regulator_trace_open(struct regulator_t* rp) {
+    regulator_trace_t* tp;
+
+    if (!(tp = (regulator_trace_t*)calloc(1, sizeof(regulator_trace_t)))) {
+        perror(rp->progname);
+        exit(1);
+    }
+    rp->trace = tp;
+    tp->terminal = !strcmp(rp->trace_filename, "-");
+    if (!tp->terminal &&
+        asprintf(&(tp->temp_filename), "%s.tmp", rp->trace_filename) < 0) {
+        perror(rp->progname);
+        exit(1);
+    }
+    tp->ticks_per_row = (rp->ticks_per_hour + 1800) / 3600;
+    if (!tp->ticks_per_row) {
+        tp->ticks_per_row = 1;
+    }
+    regulator_trace_clear(rp);
+}
+
+void regulator_trace_reset(struct regulator_t* rp) {
+    if (rp->trace) {
+        regulator_trace_clear(rp);
+    }
+}
+
+/**
+ * Rows oldest first: the part of the ring after the current row,
+ * then the part up to it.  Written to a temporary file and renamed,
+ * so a viewer reloading it never sees half a picture.  Failure costs
+ * this picture, not the run.
+ */
+static void regulator_trace_export(struct regulator_t* rp) {
+    regulator_trace_t* tp = rp->trace;
+    size_t height = (tp->rows < TRACE_ROWS) ? tp->rows : TRACE_ROWS;
+    size_t first = (tp->rows < TRACE_ROWS) ? 0 : tp->rows % TRACE_ROWS;
+    struct iovec iov[3];
+    ssize_t total;
+    int fd;
+    int err;
+
+    iov[0].iov_base = tp->header;
+    iov[0].iov_len = snprintf(tp->header, sizeof(tp->header),
+                              "P5\n%d %d\n255\n", TRACE_COLUMNS, (int)height);
+    iov[1].iov_base = tp->raster[first];
+    iov[1].iov_len = (height - first) * TRACE_COLUMNS;
+    iov[2].iov_base = tp->raster[0];
+    iov[2].iov_len = first * TRACE_COLUMNS;
+    total = iov[0].iov_len + iov[1].iov_len + iov[2].iov_len;
+
+    if ((fd = open(tp->temp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0) {
+        err = errno;
+    } else {
+        err = (writev(fd, iov, 3) == total) ? 0 : errno ? errno : EIO;
+        /* exactly once, failed write or not: once it's closed, the
+           daemon's or the recorder's thread may get the same number */
+        if (close(fd) && !err) {
+            err = errno;
+        }
+        if (!err && rename(tp->temp_filename, rp->trace_filename)) {
+            err = errno;
+        }
+        if (err) {
+            unlink(tp->temp_filename);
+        }
+    }
+    if (err) {
+        fprintf(stderr, "%s: unable to write %s: %s\n",
+                rp->progname, rp->trace_filename, strerror(err));
+    }
+}
+
+/* a finished row, squeezed to one line, in one write */
+static void regulator_trace_print(struct regulator_t* rp) {
+    regulator_trace_t* tp = rp->trace;
+    const uint8_t* row = tp->raster[(tp->rows - 1) % TRACE_ROWS];
+    size_t step = TRACE_COLUMNS / TRACE_TERM_COLUMNS;
+    size_t i;
+    size_t j;
+    int ink;
+
+    for (i = 0; i < TRACE_TERM_COLUMNS; i += 1) {
+        ink = 0;
+        for (j = 0; j < step; j += 1) {
+            if (255 - row[i * step + j] > ink) {
+                ink = 255 - row[i * step + j];
+            }
+        }
+        tp->line[i] = !ink ? ' ' : (ink <= TRACE_INK) ? '.' :
+            (ink <= 2 * TRACE_INK) ? ':' : '#';
+    }
+    tp->line[TRACE_TERM_COLUMNS] = '\n';
+    fflush(stdout);
+    if (write(1, tp->line, TRACE_TERM_COLUMNS + 1) < 0) {
+        perror(rp->progname);
+        exit(1);
+    }
+}
+
+/**
+ * After regulator_analyze_tick has judged the tick: a dot where the
+ * peak fell, as a phase of the original tick windows, so a fast or
+ * slow rate leans the line and beat error splits it in two.  Every
+ * tick moves the paper, good or not.
+ */
+void regulator_trace_add(struct regulator_t* rp) {
+    regulator_trace_t* tp = rp->trace;
+    uint8_t* pixel;
+    ssize_t phase;
+
+    if (tp->row_ticks == tp->ticks_per_row) {
+        memset(tp->raster[tp->rows % TRACE_ROWS], 255, TRACE_COLUMNS);
+        tp->rows += 1;
+        tp->row_ticks = 0;
+    }
+
+    if (rp->this_tick_has_well_defined_peak &&
+        !rp->this_tick_peak_at_boundary) {
+        phase = ((ssize_t)rp->this_tick_peak - rp->peak_offset) %
+            (ssize_t)rp->samples_per_tick;
+        if (phase < 0) {
+            phase += rp->samples_per_tick;
+        }
+        pixel = tp->raster[(tp->rows - 1) % TRACE_ROWS] +
+            phase * TRACE_COLUMNS / rp->samples_per_tick;
+        *pixel = (*pixel > TRACE_INK) ? *pixel - TRACE_INK : 0;
+    }
+
+    tp->row_ticks += 1;
+    if (tp->terminal) {
+        if (tp->row_ticks == tp->ticks_per_row) {
+            regulator_trace_print(rp);
+        }
+    } else if (rp->tick_count + 1 >= tp->next_export) {
+        regulator_trace_export(rp);
+        tp->next_export += TRACE_EXPORT_SECONDS * rp->ticks_per_hour / 3600;
+    }
+}
+
+void regulator_trace_close(struct regulator_t* rp) {
+    regulator_trace_t* tp = rp->trace;
+    if (!tp) {
+        return;
+    }
+    if (!tp->terminal) {
+        regulator_trace_export(rp);
+    }
+    free(tp->temp_filename);
+    free(tp);
+    rp->trace = NULL;
+}
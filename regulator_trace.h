@@ -0,0 +1,37 @@
+#ifndef REGULATOR_TRACE_H
+#define REGULATOR_TRACE_H
+
+#include <unistd.h>
+#include <stdint.h>
+
+#include "regulator_types.h"
+
+#define TRACE_COLUMNS        256    /* across one tick */
+#define TRACE_ROWS           512    /* one per second */
+#define TRACE_INK            96     /* taken off white per dot */
+#define TRACE_EXPORT_SECONDS 10
+#define TRACE_TERM_COLUMNS   64
+
+/**
+ * The timegrapher's paper strip: across, where in the tick each peak
+ * fell; down, time.  A ring of rows, white paper darkened by every
+ * dot, already in PGM order, so writing it out is a single writev.
+ */
+typedef struct regulator_trace_t {
+    uint8_t raster[TRACE_ROWS][TRACE_COLUMNS];
+    size_t  rows;               /* begun so far; the last is current */
+    size_t  row_ticks;          /* ticks in the current row */
+    size_t  ticks_per_row;
+    size_t  next_export;        /* tick count */
+    int     terminal;           /* --trace=-: each row as it's done */
+    char*   temp_filename;
+    char    header[32];
+    char    line[TRACE_TERM_COLUMNS + 1];
+} regulator_trace_t;
+
+void regulator_trace_open(struct regulator_t* rp);
+void regulator_trace_add(struct regulator_t* rp);
+void regulator_trace_reset(struct regulator_t* rp);
+void regulator_trace_close(struct regulator_t* rp);
+
+#endif  /* REGULATOR_TRACE_H */
@@ -1,49 +1,231 @@
 #ifndef REGULATOR_TYPES_H
 #define REGULATOR_TYPES_H
 
+#include <stdio.h>
+#include <stdint.h>
 #include <unistd.h>
-#include <sndfile.h>
-#include <pulse/simple.h>
-#include <pulse/error.h>
+#include <time.h>
+#include <pthread.h>
 
 typedef enum regulator_type_t {
     REGULATOR_TYPE_NONE,
     REGULATOR_TYPE_PULSEAUDIO,
-    REGULATOR_TYPE_SNDFILE
+    REGULATOR_TYPE_SNDFILE,
+    REGULATOR_TYPE_MULTI_STREAM,
+    REGULATOR_TYPE_RAW,
+    REGULATOR_TYPE_ALSA
 } regulator_type_t;
 
-typedef struct regulator_sndfile_t {
-    SNDFILE* sf;
-    SF_INFO sfinfo;
-    int* sf_sample_buffer;
-} regulator_sndfile_t;
+typedef enum regulator_raw_format_t {
+    REGULATOR_RAW_NONE,
+    REGULATOR_RAW_S16LE,
+    REGULATOR_RAW_S32LE,
+    REGULATOR_RAW_F32LE
+} regulator_raw_format_t;
 
-typedef struct regulator_pulseaudio_t {
-    pa_simple* pa_s;
-    int pa_error;
-    pa_sample_spec pa_ss;
-    pa_buffer_attr pa_ba;
-} regulator_pulseaudio_t;
+/**
+ * The backends' own state, and the headers it takes.  libregulator's
+ * objects are built with REGULATOR_LIBRARY and do without both: the
+ * analysis never looks at rp->implementation.
+ */
+#ifndef REGULATOR_LIBRARY
+#include "regulator_backend_types.h"
+#endif
+
+/**
+ * --cache entry layout: this header, then every frame of channel 0
+ * rectified to int16_t, native byte order, ready to mmap().
+ */
+#define CACHE_MAGIC      "RGEC"
+#define CACHE_VERSION    1
+#define CACHE_BYTE_ORDER 0x01020304
+
+typedef struct regulator_cache_header_t {
+    char     magic[4];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t header_size;
+    uint64_t key;
+    uint64_t frames_per_second;
+    uint64_t frames;
+} regulator_cache_header_t;
 
 typedef struct regulator_sample_t {
     int16_t sample;
     size_t  index;
 } regulator_sample_t;
 
+/**
+ * Running histogram of 64-sample block maxima, most of which are
+ * background noise; see regulator_noise.c.  Old counts are halved
+ * away as new ones come in.
+ */
+#define NOISE_BINS 256
+
+typedef struct regulator_noise_t {
+    uint32_t bins[NOISE_BINS];
+    size_t   total;
+    size_t   windows;
+    int16_t  floor;
+} regulator_noise_t;
+
+/**
+ * --highpass, --lowpass: a cascade of biquads, in transposed direct
+ * form II, run on channel 0 before it's rectified; see
+ * regulator_filter.c.  The state carries from one read to the next.
+ */
+#define FILTER_MAX_SECTIONS 4
+
+typedef struct regulator_biquad_t {
+    float b0, b1, b2, a1, a2;
+    float z1, z2;
+} regulator_biquad_t;
+
+typedef struct regulator_filter_t {
+    double highpass;            /* Hz, or 0 for none */
+    double lowpass;
+    size_t rate;                /* designed for, or 0 for not yet */
+    size_t sections;
+    regulator_biquad_t biquads[FILTER_MAX_SECTIONS];
+} regulator_filter_t;
+
+/**
+ * Running least-squares sums over the good ticks, for --precision and
+ * libregulator's polls; co-moments about the running means, so
+ * nothing cancels.  See ls_fit_add.
+ */
+typedef struct regulator_precision_t {
+    size_t count;
+    double mean_tick;
+    double mean_peak;
+    double sxx;
+    double sxy;
+    double syy;
+    double last_tick;           /* for the differences below */
+    double last_peak;
+    double dxx;                 /* sums over consecutive points' */
+    double dxy;                 /* differences; see regulator_precision.c */
+    double dyy;
+} regulator_precision_t;
+
+/**
+ * Capture gaps: frames the capture lost, going by the monotonic clock
+ * and the backend's latency.  See regulator_gap.c.
+ */
+typedef struct regulator_gap_t {
+    int    started;
+    struct timespec start;
+    size_t frames;              /* read since start */
+    double behind;              /* frames the clock is ahead, usually */
+    size_t pending;             /* lost and not yet skipped over */
+    size_t count;
+    size_t lost;                /* frames */
+    size_t longest;
+} regulator_gap_t;
+
+/**
+ * peak is where the tick's peak was in its window, less the
+ * regulator_t's peak_offset at the time, so that every stored peak
+ * is measured from the same place no matter how often the window has
+ * been moved since.  Only differences between peaks mean anything.
+ */
 typedef struct tick_peak_t {
-    size_t index;
-    size_t peak;
+    size_t  index;
+    ssize_t peak;
 } tick_peak_t;
 
-typedef union regulator_implementation_t {
-    regulator_pulseaudio_t pulseaudio;
-    regulator_sndfile_t    sndfile;
-} regulator_implementation_t;
+/**
+ * --timeline file layout: one header, then one record per analyzed
+ * tick, all in native byte order so the file can be mmap()ed as is.
+ * The record count is the file size's business, so a run cut short
+ * by ^C still leaves a valid file.
+ */
+#define TIMELINE_MAGIC      "RGTL"
+#define TIMELINE_VERSION    2
+#define TIMELINE_BYTE_ORDER 0x01020304
+
+#define TIMELINE_GOOD         0x01 /* stored in tick_peak_data */
+#define TIMELINE_WELL_DEFINED 0x02
+#define TIMELINE_BOUNDARY     0x04
+#define TIMELINE_EARLY        0x08
+#define TIMELINE_LATE         0x10
+#define TIMELINE_QUIET        0x20 /* below the noise floor */
+
+typedef struct regulator_timeline_header_t {
+    char     magic[4];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t header_size;
+    uint32_t record_size;
+    uint32_t samples_per_tick;
+    uint64_t frames_per_second;
+    uint64_t ticks_per_hour;
+} regulator_timeline_header_t;
+
+typedef struct regulator_timeline_record_t {
+    uint32_t tick;
+    uint32_t peak;              /* in the window; UINT32_MAX if none */
+    uint32_t flags;
+    int32_t  offset;            /* peak_offset; see tick_peak_t */
+} regulator_timeline_record_t;
+
+/**
+ * One --drift-window: the rate over the last so many seconds of data
+ * points, kept up to date as points come and go.  counts is a
+ * histogram of the window's pairwise slopes in 1/DRIFT_RESOLUTION
+ * second per day buckets; below counts those left of cursor, which
+ * stays where the last Theil-Sen median was found, for the next one
+ * is never far from it.
+ */
+typedef struct regulator_drift_point_t {
+    size_t tick;
+    float  drift;               /* seconds per day, -/+ slow/fast */
+    size_t points;
+} regulator_drift_point_t;
+
+typedef struct regulator_drift_window_t {
+    size_t    seconds;
+    size_t    ticks;
+    size_t    first;            /* oldest data point in the window */
+    size_t    slopes;
+    uint32_t* counts;
+    size_t    cursor;           /* bucket */
+    size_t    below;
+    double    scale;            /* samples per tick => bucket */
+
+    regulator_drift_point_t* history;
+    size_t history_count;       /* ever; see regulator_drift_history */
+    size_t history_alloc;
+} regulator_drift_window_t;
+
+struct regulator_t;
+
+/**
+ * Where samples come from.  read() fills ptr with up to samples
+ * rectified frames of channel 0 and returns how many it got;
+ * latency() is how many frames of capture delay sit between the
+ * microphone and us, or 0 if unknown.
+ */
+typedef struct regulator_backend_t {
+    const char* name;
+    void   (*open)(struct regulator_t* rp);
+    size_t (*read)(struct regulator_t* rp, int16_t* ptr, size_t samples);
+    void   (*close)(struct regulator_t* rp);
+    size_t (*latency)(struct regulator_t* rp);
+} regulator_backend_t;
+
+/* finds this tick's peak; see regulator_kernels.c */
+typedef void (*regulator_kernel_t)(struct regulator_t* rp);
 
 typedef struct regulator_t {
     char* progname;
     int debug;
     char* filename;
+    regulator_raw_format_t raw_format;  /* --raw: headerless PCM */
+    size_t raw_rate;
+    size_t raw_channels;
+    char* backend_name;         /* --backend */
+    char* device;               /* --device: capture device name */
     size_t ticks_per_hour;     /* e.g., 3600 * 5  = 18000 for 5 ticks/second */
     size_t samples_per_tick;      /* e.g., 44100 / 5 = 8820 */
     size_t sample_buffer_frames;  /* e.g., 44100 / 5 = 8820 */
@@ -51,8 +233,10 @@ typedef struct regulator_t {
     size_t sample_buffer_bytes;   /* e.g., 17640 * 2 = 35280 for 16-bit */
     size_t bytes_per_frame;       /* e.g., 2 * 2     = 4 for 16-bit stereo */
     size_t frames_per_second;     /* e.g.,             44100 */
+    size_t block_ms;            /* if set, read this much, not a tick */
     int no_sample_sort_buffer;
     regulator_sample_t* sample_sort_buffer; /* for finding peaks */
+    regulator_kernel_t analyze_kernel;
 
     size_t   tick_count;
     size_t   good_tick_count;
@@ -65,20 +249,72 @@ typedef struct regulator_t {
 
     tick_peak_t *tick_peak_data;
     size_t tick_peak_count;
+    ssize_t peak_offset;        /* how far the window has moved, in total */
 
     int this_tick_has_well_defined_peak;
     size_t this_tick_peak;
     int this_tick_peak_at_boundary;
     int this_tick_has_early_peak;
     int this_tick_has_late_peak;
+    int this_tick_is_quiet;
 
     size_t boundary_peak_count;
+    size_t quiet_tick_count;    /* rejected by regulator_noise_gate */
+    size_t ill_defined_tick_count;
+    regulator_noise_t noise;
+    regulator_filter_t filter;
 
     regulator_type_t type;
+    const regulator_backend_t* backend;
+#ifndef REGULATOR_LIBRARY
     regulator_implementation_t implementation;
+#endif
 
     int show_ticks;
+    double ticks_rate;          /* --ticks-rate: frames per second, or 0 */
+    struct timespec tick_display_time;
+    char* tick_display;         /* one frame of --ticks */
     int show_stats;
+    int progressive;            /* --progressive */
+    int embedded;          /* run by regulator_multi: no signals, no report */
+
+    char* timeline_filename;    /* --timeline */
+    FILE* timeline;
+
+    char* record_filename;      /* --record */
+    struct regulator_record_t* record;
+
+    int    cache;               /* --cache */
+    char*  cache_dir;
+    size_t cache_limit;         /* bytes; --cache-size is in megabytes */
+
+    size_t decode_threads;      /* --decode-threads; 0 for the default */
+
+    regulator_drift_window_t* drift_windows; /* --drift-window */
+    size_t drift_window_count;
+    char*  drift_history_filename;           /* --drift-history */
+    size_t drift_next_history_tick;
+
+    double confidence;          /* --confidence, in percent */
+
+    double precision;           /* --precision, seconds per day; 0 for off */
+    regulator_precision_t precision_sums;
+
+    size_t sparse_window;       /* --sparse, in seconds; 0 for off */
+    size_t sparse_interval;
+
+    int   daemon;               /* --daemon: don't stop after an hour */
+    char* socket_path;          /* --socket */
+    struct regulator_daemon_t* server;
+
+    regulator_gap_t gaps;       /* live capture only */
+
+    char* trace_filename;       /* --trace; "-" for the terminal */
+    struct regulator_trace_t* trace;
+
+    int   realtime;             /* --realtime */
+    int   realtime_priority;    /* --realtime=<priority>, for SCHED_FIFO */
+    struct regulator_realtime_t* rt;
 } regulator_t;
 
 #endif  /* REGULATOR_TYPES_H */
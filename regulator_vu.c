@@ -0,0 +1,185 @@
+/**
+ * regulator_vu.c --- level meter, for placing the microphone
+ *
+ * Copyright (C) 2019 Darren Embry.  GPL2.
+ */
+
+#define REGULATOR_VU_C
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "regulator.h"
+#include "regulator_vu.h"
+
+/* max and sum of squares of VU_CHUNK samples; a block is mostly these */
+static inline __attribute__((always_inline))
+void regulator_vu_chunk(const int16_t* samples, int16_t* maxp,
+                        uint64_t* sumsqp) {
+    int16_t max = *maxp;
+    uint64_t sumsq = 0;
+    for (size_t i = 0; i < VU_CHUNK; i += 1) {
+        max = samples[i] > max ? samples[i] : max;
+        sumsq += (uint32_t)(samples[i] * samples[i]);
+    }
+    *maxp = max;
+    *sumsqp += sumsq;
+}
+
+/* peak and RMS of one block of rectified samples, in one pass */
+static void regulator_vu_measure(regulator_vu_t* vp,
+                                 const int16_t* samples, size_t frames) {
+    int16_t max = 0;
+    uint64_t sumsq = 0;
+    size_t i;
+
+    for (i = 0; i + VU_CHUNK <= frames; i += VU_CHUNK) {
+        regulator_vu_chunk(samples + i, &max, &sumsq);
+    }
+    for (; i < frames; i += 1) {
+        max = samples[i] > max ? samples[i] : max;
+        sumsq += (uint32_t)(samples[i] * samples[i]);
+    }
+    vp->peak = max;
+    vp->rms = frames ? sqrt((double)sumsq / frames) : 0;
+}
+
+/**
+ * Noise is the quietest block of the last VU_HISTORY_BLOCKS, which
+ * between ticks is nothing but the room.  A block whose peak stands
+ * VU_TICK_RATIO above that holds a tick; counting those gives a
+ * rough tick rate to check against --ticks-per-hour if given.
+ */
+static void regulator_vu_update(regulator_vu_t* vp) {
+    size_t ticks = 0;
+    size_t i;
+
+    if (vp->peak >= vp->hold || vp->hold_age >= VU_HOLD_BLOCKS) {
+        vp->hold = vp->peak;
+        vp->hold_age = 0;
+    } else {
+        vp->hold_age += 1;
+    }
+
+    vp->noise = vp->rms;
+    for (i = 0; i < vp->history_count; i += 1) {
+        if (vp->rms_history[i] < vp->noise) {
+            vp->noise = vp->rms_history[i];
+        }
+    }
+    vp->rms_history[vp->history_pos] = vp->rms;
+    vp->tick_history[vp->history_pos] =
+        (vp->peak > VU_TICK_RATIO * (vp->noise > 1 ? vp->noise : 1));
+    vp->history_pos = (vp->history_pos + 1) % VU_HISTORY_BLOCKS;
+    if (vp->history_count < VU_HISTORY_BLOCKS) {
+        vp->history_count += 1;
+    }
+
+    for (i = 0; i < vp->history_count; i += 1) {
+        ticks += vp->tick_history[i];
+    }
+    vp->tick_rate = ticks / (vp->history_count * vp->block_seconds);
+    vp->snr_db = 20 * log10((vp->hold > 1 ? vp->hold : 1) /
+                            (vp->noise > 1 ? vp->noise : 1));
+
+    vp->good = (vp->history_count == VU_HISTORY_BLOCKS &&
+                vp->snr_db >= VU_GOOD_SNR_DB && vp->tick_rate > 0);
+    if (vp->good && vp->expected_rate) {
+        vp->good = (fabs(vp->tick_rate - vp->expected_rate) * 100 <=
+                    vp->expected_rate * VU_RATE_TOLERANCE);
+    }
+}
+
+static double regulator_vu_db(double level) {
+    return 20 * log10((level > 1 ? level : 1) / INT16_MAX);
+}
+
+/* dBFS to meter columns */
+static int regulator_vu_column(double level) {
+    int column = (int)lround((regulator_vu_db(level) - VU_FLOOR_DB) *
+                             VU_COLUMNS / -VU_FLOOR_DB);
+    return column < 0 ? 0 : column > VU_COLUMNS ? VU_COLUMNS : column;
+}
+
+/**
+ * "[####====    |   ]": RMS, then peak, then peak hold, -60 to 0
+ * dBFS, plus the numbers.  Built in one buffer and written at once.
+ */
+static void regulator_vu_show(regulator_vu_t* vp) {
+    int rms = regulator_vu_column(vp->rms);
+    int peak = regulator_vu_column(vp->peak);
+    int hold = regulator_vu_column(vp->hold);
+    char* p = vp->line;
+    char* q;
+    int i;
+
+    *p++ = '[';
+    for (i = 0; i < VU_COLUMNS; i += 1) {
+        *p++ = (i < rms) ? '#' : (i < peak) ? '=' :
+            (i == hold - 1) ? '|' : ' ';
+    }
+    *p++ = ']';
+    p += snprintf(p, vp->line + VU_LINE_SIZE - p,
+                  " peak %5.1f rms %5.1f snr %4.1f dB %4.1f/s %s\r",
+                  regulator_vu_db(vp->peak), regulator_vu_db(vp->rms),
+                  vp->snr_db, vp->tick_rate, vp->good ? "GOOD" : "    ");
+    if (p > vp->line + VU_LINE_SIZE - 1) {
+        p = vp->line + VU_LINE_SIZE - 1;
+    }
+
+    for (q = vp->line; q < p; ) {
+        ssize_t n = write(fileno(stdout), q, p - q);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        q += n;
+    }
+}
+
+/**
+ * "regulator vu": a live level meter off whichever backend would be
+ * used for a run, opened for 50 ms blocks instead of ticks.
+ */
+void regulator_vu_run(struct regulator_t* rp) {
+    regulator_vu_t vu = {};
+    int save__no_sample_sort_buffer = rp->no_sample_sort_buffer;
+    int16_t* buffer;
+    size_t frames;
+
+    rp->no_sample_sort_buffer = 1;
+    rp->block_ms = VU_BLOCK_MS;
+    regulator_choose_backend(rp)->open(rp);
+
+    frames = rp->sample_buffer_frames;
+    vu.block_seconds = (double)frames / rp->frames_per_second;
+    vu.expected_rate = rp->ticks_per_hour / 3600.0;
+    if (rp->debug >= 1) {
+        printf("regulator_vu_run: %s backend, %d frames per block\n",
+               rp->backend->name, (int)frames);
+    }
+
+    if (!(buffer = (int16_t*)malloc(sizeof(int16_t) * frames))) {
+        perror(rp->progname);
+        exit(1);
+    }
+    fflush(stdout);
+    while (rp->backend->read(rp, buffer, frames) == frames) {
+        regulator_vu_measure(&vu, buffer, frames);
+        regulator_vu_update(&vu);
+        regulator_vu_show(&vu);
+    }
+    putchar('\n');
+    free(buffer);
+
+    rp->backend->close(rp);
+    rp->backend = NULL;
+    rp->type = REGULATOR_TYPE_NONE;
+    rp->block_ms = 0;
+    rp->no_sample_sort_buffer = save__no_sample_sort_buffer;
+}
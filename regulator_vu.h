@@ -0,0 +1,44 @@
+#ifndef REGULATOR_VU_H
+#define REGULATOR_VU_H
+
+#include <unistd.h>
+#include <stdint.h>
+
+#include "regulator_types.h"
+
+#define VU_BLOCK_MS        50
+#define VU_CHUNK           64
+#define VU_HISTORY_BLOCKS  40    /* 2 seconds */
+#define VU_HOLD_BLOCKS     30
+#define VU_FLOOR_DB        -60
+#define VU_COLUMNS         60
+#define VU_TICK_RATIO      6     /* tick peak over noise RMS */
+#define VU_GOOD_SNR_DB     20
+#define VU_RATE_TOLERANCE  15    /* percent */
+#define VU_LINE_SIZE       160
+
+typedef struct regulator_vu_t {
+    double   block_seconds;
+    double   expected_rate;     /* ticks per second, or 0 if unknown */
+
+    int16_t  peak;
+    double   rms;
+    int16_t  hold;
+    size_t   hold_age;          /* blocks */
+
+    double   rms_history[VU_HISTORY_BLOCKS];
+    uint8_t  tick_history[VU_HISTORY_BLOCKS];
+    size_t   history_pos;
+    size_t   history_count;
+
+    double   noise;             /* quietest recent block's RMS */
+    double   snr_db;
+    double   tick_rate;         /* ticks per second */
+    int      good;
+
+    char     line[VU_LINE_SIZE];
+} regulator_vu_t;
+
+void regulator_vu_run(struct regulator_t* rp);
+
+#endif  /* REGULATOR_VU_H */